@@ -0,0 +1,80 @@
+#include "arena.h"
+
+#include <stdalign.h>
+#include <stdlib.h>
+
+struct arena_block {
+	struct arena_block *next;
+	size_t size;
+	size_t off;
+	alignas(max_align_t) char data[];
+};
+
+#define ARENA_ALIGN alignof(max_align_t)
+
+static struct arena_block *new_block(size_t size,
+				     struct arena_block *next)
+{
+	struct arena_block *block = malloc(sizeof(*block) + size);
+	if (!block)
+		return NULL;
+	block->next = next;
+	block->size = size;
+	block->off = 0;
+	return block;
+}
+
+bool arena_init(struct arena *a, size_t block_size, size_t max_block_size)
+{
+	*a = (struct arena){ .block_size = block_size,
+			     .max_block_size = max_block_size };
+	a->head = new_block(block_size, NULL);
+	return a->head != NULL;
+}
+
+void arena_free(struct arena *a)
+{
+	struct arena_block *block = a->head;
+	while (block) {
+		struct arena_block *next = block->next;
+		free(block);
+		block = next;
+	}
+	a->head = NULL;
+}
+
+void *arena_alloc(struct arena *a, size_t size)
+{
+	size = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+	struct arena_block *block = a->head;
+	if (!block || block->size - block->off < size) {
+		size_t block_size = block ? 2 * block->size : a->block_size;
+		if (block_size < size)
+			block_size = size;
+		if (!(block = new_block(block_size, a->head)))
+			return NULL;
+		a->head = block;
+	}
+	void *ptr = block->data + block->off;
+	block->off += size;
+	a->used += size;
+	return ptr;
+}
+
+void arena_reset(struct arena *a)
+{
+	if (a->head && !a->head->next) {
+		a->head->off = 0;
+		a->used = 0;
+		return;
+	}
+
+	// spilled over: replace the chain with one block big enough for it
+	size_t block_size = a->used > a->block_size ? a->used : a->block_size;
+	if (block_size > a->max_block_size)
+		block_size = a->max_block_size;
+	arena_free(a);
+	a->block_size = block_size;
+	a->head = new_block(block_size, NULL);
+	a->used = 0;
+}
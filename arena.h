@@ -0,0 +1,29 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// bump allocator: allocations are never freed individually, arena_reset()
+// releases all of them at once. grows by chaining blocks when full
+
+struct arena_block;
+
+struct arena {
+	struct arena_block *head; // block currently allocated from
+	size_t block_size; // size of the block kept across resets
+	size_t max_block_size; // never keep a block bigger than this
+	size_t used; // bytes allocated since the last reset
+};
+
+bool arena_init(struct arena *a, size_t block_size, size_t max_block_size);
+void arena_free(struct arena *a);
+
+// aligned for any type, NULL if out of memory
+void *arena_alloc(struct arena *a, size_t size);
+
+// drop every allocation. if they spilled into extra blocks, the kept block is
+// regrown (up to max_block_size) so the next round fits in one
+void arena_reset(struct arena *a);
+
+#endif
@@ -0,0 +1,300 @@
+#include "asset.h"
+#include "log.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// archive layout: header, count entries sorted by name, then the file data,
+// each file starting ASSET_ALIGN aligned
+#define ASSET_MAGIC 0x31504b41u // "AKP1"
+#define ASSET_VERSION 1
+#define ASSET_ALIGN 16
+
+struct asset_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t count;
+	uint32_t pad;
+};
+
+struct asset_entry {
+	char name[ASSET_NAME_MAX]; // NUL padded
+	uint64_t offset; // from the start of the archive
+	uint64_t size;
+	int64_t mtime; // of the file when packed
+};
+_Static_assert(sizeof(struct asset_entry) == 80, "archive entries are 80 bytes");
+
+static char base_path[PATH_MAX];
+static struct asset archive;
+static const struct asset_entry *archive_entries;
+static uint32_t archive_count;
+
+// map a whole file, false if it can't be opened
+static bool map_file(const char *path, struct asset *asset)
+{
+	int fd = open(path, O_RDONLY);
+	if (fd == -1)
+		return false;
+
+	struct stat st;
+	if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode)) {
+		close(fd);
+		return false;
+	}
+
+	*asset = (struct asset){ .data = "", .mtime = st.st_mtime };
+	if (st.st_size > 0) {
+		void *mapping =
+			mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (mapping == MAP_FAILED) {
+			log_err("mmap of %s failed", path);
+			close(fd);
+			return false;
+		}
+		asset->data = mapping;
+		asset->size = st.st_size;
+		asset->mapping = mapping;
+		asset->mapping_size = st.st_size;
+	}
+	close(fd);
+	return true;
+}
+
+static bool archive_valid(const struct asset *pak)
+{
+	if (pak->size < sizeof(struct asset_header))
+		return false;
+	const struct asset_header *header = (const void *)pak->data;
+	if (header->magic != ASSET_MAGIC || header->version != ASSET_VERSION)
+		return false;
+	size_t entries_end = sizeof(*header) +
+			     (size_t)header->count * sizeof(struct asset_entry);
+	if (entries_end > pak->size)
+		return false;
+	const struct asset_entry *entries =
+		(const void *)(pak->data + sizeof(*header));
+	for (uint32_t i = 0; i < header->count; ++i) {
+		if (entries[i].name[ASSET_NAME_MAX - 1] != '\0' ||
+		    entries[i].offset > pak->size ||
+		    entries[i].size > pak->size - entries[i].offset)
+			return false;
+	}
+	return true;
+}
+
+bool asset_init(const char *base_dir)
+{
+	int len = snprintf(base_path, sizeof(base_path), "%s", base_dir);
+	if (len > 1 && len < (int)sizeof(base_path) &&
+	    base_path[len - 1] == '/')
+		base_path[len - 1] = '\0';
+
+	char pak_path[PATH_MAX];
+	asset_path(ASSET_ARCHIVE, pak_path, sizeof(pak_path));
+	if (!map_file(pak_path, &archive)) {
+		log_info("no asset archive, loading assets from %s", base_dir);
+		return true;
+	}
+	if (!archive_valid(&archive)) {
+		log_warn("ignoring invalid asset archive %s", pak_path);
+		asset_close(&archive);
+		return true;
+	}
+	const struct asset_header *header = (const void *)archive.data;
+	archive_entries = (const void *)(archive.data + sizeof(*header));
+	archive_count = header->count;
+	log_info("mapped asset archive %s with %u files", pak_path,
+		 archive_count);
+	return true;
+}
+
+void asset_quit(void)
+{
+	asset_close(&archive);
+	archive_entries = NULL;
+	archive_count = 0;
+}
+
+static const struct asset_entry *find_entry(const char *name)
+{
+	uint32_t lo = 0, hi = archive_count;
+	while (lo < hi) {
+		uint32_t mid = lo + (hi - lo) / 2;
+		int cmp = strcmp(name, archive_entries[mid].name);
+		if (cmp == 0)
+			return &archive_entries[mid];
+		if (cmp < 0)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+	return NULL;
+}
+
+bool asset_open(const char *name, struct asset *asset)
+{
+	const struct asset_entry *entry = find_entry(name);
+	if (entry) {
+		*asset = (struct asset){ .data = archive.data + entry->offset,
+					 .size = entry->size,
+					 .mtime = entry->mtime };
+		return true;
+	}
+
+	char path[PATH_MAX];
+	asset_path(name, path, sizeof(path));
+	return map_file(path, asset);
+}
+
+void asset_close(struct asset *asset)
+{
+	if (asset->mapping)
+		munmap(asset->mapping, asset->mapping_size);
+	*asset = (struct asset){ 0 };
+}
+
+void asset_path(const char *name, char *dest, size_t len)
+{
+	int n = snprintf(dest, len, "%s/%s", base_path, name);
+	// a cut off path just fails to open
+	if (n < 0 || (size_t)n >= len)
+		log_warn("asset path too long: %s/%s", base_path, name);
+}
+
+static int compare_entries(const void *a, const void *b)
+{
+	return strcmp(((const struct asset_entry *)a)->name,
+		      ((const struct asset_entry *)b)->name);
+}
+
+// append the regular files in base_dir/dir to *entries
+static bool list_dir(const char *base_dir, const char *dir,
+		     struct asset_entry **entries, uint32_t *count,
+		     uint32_t *cap)
+{
+	char dir_path[PATH_MAX];
+	int n = snprintf(dir_path, sizeof(dir_path), "%s/%s", base_dir, dir);
+	if (n < 0 || n >= (int)sizeof(dir_path)) {
+		log_err("path too long: %s/%s", base_dir, dir);
+		return false;
+	}
+	DIR *d = opendir(dir_path);
+	if (!d) {
+		log_err("unable to open %s", dir_path);
+		return false;
+	}
+
+	struct dirent *ent;
+	while ((ent = readdir(d)) != NULL) {
+		if (ent->d_name[0] == '.')
+			continue;
+		char path[PATH_MAX];
+		n = snprintf(path, sizeof(path), "%s/%s", dir_path, ent->d_name);
+		if (n < 0 || n >= (int)sizeof(path)) {
+			log_warn("path too long, skipping %s/%s", dir_path,
+				 ent->d_name);
+			continue;
+		}
+		struct stat st;
+		if (stat(path, &st) == -1 || !S_ISREG(st.st_mode))
+			continue;
+
+		struct asset_entry entry = { .size = st.st_size,
+					     .mtime = st.st_mtime };
+		int len = snprintf(entry.name, sizeof(entry.name), "%s/%s",
+				   dir, ent->d_name);
+		if (len >= ASSET_NAME_MAX) {
+			log_warn("name too long to pack, skipping %s", path);
+			continue;
+		}
+		if (*count == *cap) {
+			uint32_t new_cap = *cap ? *cap * 2 : 64;
+			struct asset_entry *grown =
+				realloc(*entries, new_cap * sizeof(**entries));
+			if (!grown) {
+				log_err("out of memory listing %s", dir_path);
+				closedir(d);
+				return false;
+			}
+			*entries = grown;
+			*cap = new_cap;
+		}
+		(*entries)[(*count)++] = entry;
+	}
+	closedir(d);
+	return true;
+}
+
+bool asset_pack(const char *pak_file, const char *base_dir,
+		const char *const *dirs, int num_dirs)
+{
+	struct asset_entry *entries = NULL;
+	uint32_t count = 0, cap = 0;
+	for (int i = 0; i < num_dirs; ++i) {
+		if (!list_dir(base_dir, dirs[i], &entries, &count, &cap)) {
+			free(entries);
+			return false;
+		}
+	}
+	qsort(entries, count, sizeof(*entries), compare_entries);
+
+	uint64_t offset = sizeof(struct asset_header) +
+			  (uint64_t)count * sizeof(struct asset_entry);
+	for (uint32_t i = 0; i < count; ++i) {
+		offset = (offset + ASSET_ALIGN - 1) & ~(uint64_t)(ASSET_ALIGN - 1);
+		entries[i].offset = offset;
+		offset += entries[i].size;
+	}
+
+	char tmp_file[PATH_MAX];
+	snprintf(tmp_file, sizeof(tmp_file), "%s.tmp", pak_file);
+	FILE *fp = fopen(tmp_file, "wb");
+	if (!fp) {
+		log_err("unable to write %s", tmp_file);
+		free(entries);
+		return false;
+	}
+
+	struct asset_header header = { .magic = ASSET_MAGIC,
+				       .version = ASSET_VERSION,
+				       .count = count };
+	bool ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+	if (count)
+		ok &= fwrite(entries, sizeof(*entries), count, fp) == count;
+
+	static const char zeros[ASSET_ALIGN];
+	for (uint32_t i = 0; ok && i < count; ++i) {
+		long pad = (long)entries[i].offset - ftell(fp);
+		ok &= pad >= 0 && pad < ASSET_ALIGN &&
+		      fwrite(zeros, 1, pad, fp) == (size_t)pad;
+
+		char path[PATH_MAX];
+		snprintf(path, sizeof(path), "%s/%s", base_dir, entries[i].name);
+		struct asset file;
+		if (!map_file(path, &file) || file.size != entries[i].size) {
+			log_err("%s changed while packing", path);
+			ok = false;
+			break;
+		}
+		ok &= fwrite(file.data, 1, file.size, fp) == file.size;
+		asset_close(&file);
+	}
+	ok &= fclose(fp) == 0;
+	free(entries);
+
+	if (!ok || rename(tmp_file, pak_file) != 0) {
+		log_err("unable to write %s", pak_file);
+		remove(tmp_file);
+		return false;
+	}
+	log_info("packed %u files into %s", count, pak_file);
+	return true;
+}
@@ -0,0 +1,44 @@
+#ifndef ASSET_H
+#define ASSET_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// read-only access to shaders and resources. files are mapped rather than
+// read, loaders get the bytes without a copy. if the base dir holds an
+// archive made by asset_pack(), it is mapped once at init and files inside it
+// are found without touching the filesystem. files not in the archive are
+// mapped one by one
+
+#define ASSET_ARCHIVE "assets.pak"
+// longest name, relative to the base dir, that fits in the archive
+#define ASSET_NAME_MAX 56
+
+// an open file. data isn't NUL terminated
+struct asset {
+	const char *data;
+	size_t size;
+	int64_t mtime;
+	// mapping to release on close, NULL if data lies in the archive
+	void *mapping;
+	size_t mapping_size;
+};
+
+// base_dir is where shaders/ and resources/ live
+bool asset_init(const char *base_dir);
+void asset_quit(void);
+
+// name is relative to the base dir, e.g. "shaders/color.frag.spv". returns
+// false without logging if there is no such file
+bool asset_open(const char *name, struct asset *asset);
+void asset_close(struct asset *asset);
+
+// filesystem path of name, for writing files next to the assets
+void asset_path(const char *name, char *dest, size_t len);
+
+// pack every file directly in the given dirs of base_dir into pak_file
+bool asset_pack(const char *pak_file, const char *base_dir,
+		const char *const *dirs, int num_dirs);
+
+#endif
@@ -0,0 +1,25 @@
+// packs shaders/ and resources/ of a build dir into assets.pak, which the
+// client then maps in one go at startup instead of opening each file. built
+// as the asset_pack target, run as asset_pack <build dir>
+#include "asset.h"
+#include "log.h"
+
+#include <limits.h>
+#include <stdio.h>
+
+int main(int argc, char **argv)
+{
+	if (argc != 2) {
+		fprintf(stderr, "usage: %s <build dir>\n", argv[0]);
+		return 1;
+	}
+	log_init();
+
+	static const char *const dirs[] = { "shaders", "resources" };
+	char pak_file[PATH_MAX];
+	snprintf(pak_file, sizeof(pak_file), "%s/%s", argv[1], ASSET_ARCHIVE);
+	return asset_pack(pak_file, argv[1], dirs,
+			  sizeof(dirs) / sizeof(dirs[0])) ?
+		       0 :
+		       1;
+}
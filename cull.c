@@ -0,0 +1,277 @@
+#include "cull.h"
+
+#include <SDL3/SDL.h>
+
+#include <math.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64)
+#define CULL_X86
+#include <immintrin.h>
+#if defined(__GNUC__)
+// avx2 kernel is compiled for avx2 on its own and picked at runtime
+#define CULL_HAS_AVX2
+#endif
+#endif
+
+// per plane frustum data in the form the kernels use
+struct cull_planes {
+	float nx[6], ny[6], nz[6], d[6];
+	// a box is outside a plane if its center is further than this below
+	// it, i.e. minus the box's extent projected onto the plane normal
+	float limit[6];
+};
+
+typedef int (*cull_fn)(const struct cull_planes *planes, const int16_t *x,
+		       const int16_t *y, const uint8_t *type, int first,
+		       int count, uint32_t *visible);
+
+void frustum_from_viewproj(mat4 viewproj, struct frustum *frustum)
+{
+	glm_frustum_planes(viewproj, frustum->planes);
+}
+
+bool frustum_box_visible(const struct frustum *frustum, const vec3 min,
+			 const vec3 max)
+{
+	for (int i = 0; i < 6; ++i) {
+		const float *plane = frustum->planes[i];
+		// the box corner furthest along the plane normal
+		float dist = plane[3];
+		for (int a = 0; a < 3; ++a)
+			dist += plane[a] * (plane[a] >= 0.0f ? max[a] : min[a]);
+		if (dist < 0.0f)
+			return false;
+	}
+	return true;
+}
+
+static void prepare_planes(const struct frustum *frustum,
+			   struct cull_planes *planes)
+{
+	for (int i = 0; i < 6; ++i) {
+		const float *plane = frustum->planes[i];
+		planes->nx[i] = plane[0];
+		planes->ny[i] = plane[1];
+		planes->nz[i] = plane[2];
+		planes->d[i] = plane[3];
+		planes->limit[i] = -TILE_HALF_EXTENT *
+				   (fabsf(plane[0]) + fabsf(plane[1]) +
+				    fabsf(plane[2]));
+	}
+}
+
+// the kernels cull tiles [first, count) and return how many were visible
+
+static int cull_scalar(const struct cull_planes *planes, const int16_t *x,
+		       const int16_t *y, const uint8_t *type, int first,
+		       int count, uint32_t *visible)
+{
+	int num_visible = 0;
+	for (int i = first; i < count; ++i) {
+		vec3 c;
+		map_tile_center(x[i], y[i], type[i], c);
+		bool inside = true;
+		for (int p = 0; p < 6; ++p) {
+			float dist = planes->nx[p] * c[0] + planes->ny[p] * c[1] +
+				     planes->nz[p] * c[2] + planes->d[p];
+			inside &= dist >= planes->limit[p];
+		}
+		visible[num_visible] = (uint32_t)i;
+		num_visible += inside;
+	}
+	return num_visible;
+}
+
+#ifdef CULL_X86
+// sse2 is part of x86-64, 4 tiles per step
+static int cull_sse2(const struct cull_planes *planes, const int16_t *x,
+		     const int16_t *y, const uint8_t *type, int first,
+		     int count, uint32_t *visible)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i floor_type = _mm_set1_epi32(MTYPE_FLOOR);
+	const __m128 floor_y = _mm_set1_ps(-2.0f);
+	const __m128 half = _mm_set1_ps(0.5f);
+	const __m128 two = _mm_set1_ps(2.0f);
+	const __m128 minus_two = _mm_set1_ps(-2.0f);
+
+	int num_visible = 0;
+	int i = first;
+	for (; i + 4 <= count; i += 4) {
+		// sign extend int16 to int32, zero extend the type bytes
+		__m128i xi = _mm_loadl_epi64((const __m128i *)(x + i));
+		__m128i yi = _mm_loadl_epi64((const __m128i *)(y + i));
+		xi = _mm_srai_epi32(_mm_unpacklo_epi16(xi, xi), 16);
+		yi = _mm_srai_epi32(_mm_unpacklo_epi16(yi, yi), 16);
+		int packed_type;
+		memcpy(&packed_type, type + i, sizeof(packed_type));
+		__m128i ti = _mm_cvtsi32_si128(packed_type);
+		ti = _mm_unpacklo_epi16(_mm_unpacklo_epi8(ti, zero), zero);
+
+		// see map_tile_center()
+		__m128 cx = _mm_add_ps(
+			_mm_mul_ps(_mm_cvtepi32_ps(yi), minus_two), half);
+		__m128 cy = _mm_and_ps(
+			_mm_castsi128_ps(_mm_cmpeq_epi32(ti, floor_type)),
+			floor_y);
+		__m128 cz = _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(xi), two),
+				       half);
+
+		__m128 inside = _mm_castsi128_ps(_mm_cmpeq_epi32(zero, zero));
+		for (int p = 0; p < 6; ++p) {
+			__m128 dist = _mm_add_ps(
+				_mm_add_ps(
+					_mm_add_ps(
+						_mm_mul_ps(_mm_set1_ps(
+								   planes->nx[p]),
+							   cx),
+						_mm_mul_ps(_mm_set1_ps(
+								   planes->ny[p]),
+							   cy)),
+					_mm_mul_ps(_mm_set1_ps(planes->nz[p]),
+						   cz)),
+				_mm_set1_ps(planes->d[p]));
+			inside = _mm_and_ps(
+				inside,
+				_mm_cmpge_ps(dist,
+					     _mm_set1_ps(planes->limit[p])));
+		}
+
+		// branchless compaction of the surviving indices
+		int mask = _mm_movemask_ps(inside);
+		for (int b = 0; b < 4; ++b) {
+			visible[num_visible] = (uint32_t)(i + b);
+			num_visible += (mask >> b) & 1;
+		}
+	}
+	return num_visible + cull_scalar(planes, x, y, type, i, count,
+					 visible + num_visible);
+}
+#endif
+
+#ifdef CULL_HAS_AVX2
+// 8 tiles per step. no fma, so results match the other kernels exactly
+__attribute__((target("avx2"))) static int
+cull_avx2(const struct cull_planes *planes, const int16_t *x, const int16_t *y,
+	  const uint8_t *type, int first, int count, uint32_t *visible)
+{
+	const __m256i floor_type = _mm256_set1_epi32(MTYPE_FLOOR);
+	const __m256 floor_y = _mm256_set1_ps(-2.0f);
+	const __m256 half = _mm256_set1_ps(0.5f);
+	const __m256 two = _mm256_set1_ps(2.0f);
+	const __m256 minus_two = _mm256_set1_ps(-2.0f);
+
+	__m256 nx[6], ny[6], nz[6], d[6], limit[6];
+	for (int p = 0; p < 6; ++p) {
+		nx[p] = _mm256_set1_ps(planes->nx[p]);
+		ny[p] = _mm256_set1_ps(planes->ny[p]);
+		nz[p] = _mm256_set1_ps(planes->nz[p]);
+		d[p] = _mm256_set1_ps(planes->d[p]);
+		limit[p] = _mm256_set1_ps(planes->limit[p]);
+	}
+
+	int num_visible = 0;
+	int i = first;
+	for (; i + 8 <= count; i += 8) {
+		__m256i xi = _mm256_cvtepi16_epi32(
+			_mm_loadu_si128((const __m128i *)(x + i)));
+		__m256i yi = _mm256_cvtepi16_epi32(
+			_mm_loadu_si128((const __m128i *)(y + i)));
+		__m256i ti = _mm256_cvtepu8_epi32(
+			_mm_loadl_epi64((const __m128i *)(type + i)));
+
+		// see map_tile_center()
+		__m256 cx = _mm256_add_ps(
+			_mm256_mul_ps(_mm256_cvtepi32_ps(yi), minus_two), half);
+		__m256 cy = _mm256_and_ps(
+			_mm256_castsi256_ps(_mm256_cmpeq_epi32(ti, floor_type)),
+			floor_y);
+		__m256 cz = _mm256_add_ps(
+			_mm256_mul_ps(_mm256_cvtepi32_ps(xi), two), half);
+
+		__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+		for (int p = 0; p < 6; ++p) {
+			__m256 dist = _mm256_add_ps(
+				_mm256_add_ps(
+					_mm256_add_ps(_mm256_mul_ps(nx[p], cx),
+						      _mm256_mul_ps(ny[p], cy)),
+					_mm256_mul_ps(nz[p], cz)),
+				d[p]);
+			inside = _mm256_and_ps(
+				inside, _mm256_cmp_ps(dist, limit[p],
+						      _CMP_GE_OQ));
+		}
+
+		int mask = _mm256_movemask_ps(inside);
+		for (int b = 0; b < 8; ++b) {
+			visible[num_visible] = (uint32_t)(i + b);
+			num_visible += (mask >> b) & 1;
+		}
+	}
+	return num_visible + cull_scalar(planes, x, y, type, i, count,
+					 visible + num_visible);
+}
+#endif
+
+static const struct {
+	const char *name;
+	cull_fn fn;
+} cull_impls[CULL_IMPL_COUNT] = {
+	[CULL_SCALAR] = { "scalar", cull_scalar },
+#ifdef CULL_X86
+	[CULL_SSE2] = { "sse2", cull_sse2 },
+#else
+	[CULL_SSE2] = { "sse2", NULL },
+#endif
+#ifdef CULL_HAS_AVX2
+	[CULL_AVX2] = { "avx2", cull_avx2 },
+#else
+	[CULL_AVX2] = { "avx2", NULL },
+#endif
+};
+
+const char *cull_impl_name(enum cull_impl impl)
+{
+	return cull_impls[impl].name;
+}
+
+bool cull_impl_supported(enum cull_impl impl)
+{
+	if (!cull_impls[impl].fn)
+		return false;
+	switch (impl) {
+	case CULL_SSE2:
+		return SDL_HasSSE2();
+	case CULL_AVX2:
+		return SDL_HasAVX2();
+	default:
+		return true;
+	}
+}
+
+int cull_tiles_impl(enum cull_impl impl, const struct frustum *frustum,
+		    const int16_t *x, const int16_t *y, const uint8_t *type,
+		    int count, uint32_t *visible)
+{
+	struct cull_planes planes;
+	prepare_planes(frustum, &planes);
+	return cull_impls[impl].fn(&planes, x, y, type, 0, count, visible);
+}
+
+int cull_tiles(const struct frustum *frustum, const int16_t *x,
+	       const int16_t *y, const uint8_t *type, int count,
+	       uint32_t *visible)
+{
+	static int best = -1;
+	if (best < 0) {
+		best = CULL_SCALAR;
+		for (int i = CULL_IMPL_COUNT - 1; i > CULL_SCALAR; --i) {
+			if (cull_impl_supported(i)) {
+				best = i;
+				break;
+			}
+		}
+	}
+	return cull_tiles_impl(best, frustum, x, y, type, count, visible);
+}
@@ -0,0 +1,63 @@
+#ifndef CULL_H
+#define CULL_H
+
+#include "map.h"
+
+#include "cglm/include/cglm/cglm.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// view frustum as 6 normalized planes (left, right, bottom, top, near, far),
+// a point p is inside a plane if dot(plane.xyz, p) + plane.w >= 0. the far
+// plane doubles as the distance cull
+struct frustum {
+	vec4 planes[6];
+};
+
+// map tiles are cubes extending +-1 around their center, see
+// position_color_shifted.vert and cull_tiles.comp
+#define TILE_HALF_EXTENT 1.0f
+
+// world space center of a map tile, the axes are flipped and floors sit
+// one tile lower
+static inline void map_tile_center(int x, int y, enum map_type type,
+				   vec3 dest)
+{
+	dest[0] = (float)y * -2.0f + 0.5f;
+	dest[1] = type == MTYPE_FLOOR ? -2.0f : 0.0f;
+	dest[2] = (float)x * 2.0f + 0.5f;
+}
+
+void frustum_from_viewproj(mat4 viewproj, struct frustum *frustum);
+
+// whether the axis aligned box [min, max] touches the frustum, for culling
+// larger things like terrain chunks one at a time
+bool frustum_box_visible(const struct frustum *frustum, const vec3 min,
+			 const vec3 max);
+
+// kernels of cull_tiles(), all give identical results
+enum cull_impl {
+	CULL_SCALAR,
+	CULL_SSE2,
+	CULL_AVX2,
+	CULL_IMPL_COUNT
+};
+
+const char *cull_impl_name(enum cull_impl impl);
+bool cull_impl_supported(enum cull_impl impl);
+
+// writes the index of every tile whose box touches the frustum to visible,
+// in order, and returns how many. tiles are given as parallel streams. uses
+// the fastest kernel the cpu supports, this is also the cpu reference of the
+// gpu cull pass
+int cull_tiles(const struct frustum *frustum, const int16_t *x,
+	       const int16_t *y, const uint8_t *type, int count,
+	       uint32_t *visible);
+
+// same with a given kernel, which must be supported
+int cull_tiles_impl(enum cull_impl impl, const struct frustum *frustum,
+		    const int16_t *x, const int16_t *y, const uint8_t *type,
+		    int count, uint32_t *visible);
+
+#endif
@@ -0,0 +1,103 @@
+// times the cpu tile cull kernels from cull.c at a window's worth of tiles, a
+// whole level and a large synthetic map, and checks they agree. built as the
+// cull_bench target, exits non-zero if a kernel disagrees with the scalar one
+#include "cull.h"
+
+#include <SDL3/SDL.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// tiles per timed run, ~10M tiles so each size runs long enough to time
+#define BENCH_TILES (10 * 1000 * 1000)
+
+struct bench_size {
+	const char *name;
+	int w, h;
+};
+
+static const struct bench_size sizes[] = {
+	{ "window 15x15", 15, 15 },
+	{ "level 80x70", GXM, GYM },
+	{ "100k 400x250", 400, 250 },
+};
+
+// same camera setup as camera_to_viewproj() in render.c, standing in the
+// middle of the map looking along it
+static void bench_viewproj(int w, int h, mat4 dest)
+{
+	vec3 center;
+	map_tile_center(w / 2, h / 2, MTYPE_WALL, center);
+	vec3 pos = { center[0], 1.0f, center[2] };
+	vec3 target = { center[0] - 1.0f, 1.0f, center[2] + 1.0f };
+	mat4 lookat, projection;
+	glm_lookat(pos, target, (vec3){ 0.0f, 1.0f, 0.0f }, lookat);
+	glm_perspective_default(1.777777f, projection);
+	glm_mat4_mul(projection, lookat, dest);
+}
+
+int main(void)
+{
+	int status = 0;
+	for (size_t s = 0; s < SDL_arraysize(sizes); ++s) {
+		const struct bench_size *size = &sizes[s];
+		int count = size->w * size->h;
+		int16_t *x = malloc(count * sizeof(*x));
+		int16_t *y = malloc(count * sizeof(*y));
+		uint8_t *type = malloc(count);
+		uint32_t *visible = malloc(count * sizeof(*visible));
+		uint32_t *expected = malloc(count * sizeof(*expected));
+
+		// walls and floors in a fixed pattern
+		for (int i = 0; i < count; ++i) {
+			x[i] = (int16_t)(i % size->w);
+			y[i] = (int16_t)(i / size->w);
+			type[i] = (i * 7) % 3 ? MTYPE_FLOOR : MTYPE_WALL;
+		}
+
+		mat4 viewproj;
+		bench_viewproj(size->w, size->h, viewproj);
+		struct frustum frustum;
+		frustum_from_viewproj(viewproj, &frustum);
+
+		int expected_count = cull_tiles_impl(CULL_SCALAR, &frustum, x,
+						     y, type, count, expected);
+		printf("%s: %d of %d tiles visible\n", size->name,
+		       expected_count, count);
+
+		int runs = BENCH_TILES / count;
+		for (int impl = 0; impl < CULL_IMPL_COUNT; ++impl) {
+			if (!cull_impl_supported(impl)) {
+				printf("  %-7s unsupported\n",
+				       cull_impl_name(impl));
+				continue;
+			}
+
+			int n = 0;
+			Uint64 start = SDL_GetTicksNS();
+			for (int r = 0; r < runs; ++r)
+				n = cull_tiles_impl(impl, &frustum, x, y, type,
+						    count, visible);
+			Uint64 elapsed = SDL_GetTicksNS() - start;
+
+			bool match = n == expected_count &&
+				     !memcmp(visible, expected,
+					     n * sizeof(*visible));
+			if (!match)
+				status = 1;
+			printf("  %-7s %8.3f us/cull %6.2f ns/tile%s\n",
+			       cull_impl_name(impl),
+			       (double)elapsed / runs / 1000.0,
+			       (double)elapsed / runs / count,
+			       match ? "" : "  MISMATCH");
+		}
+
+		free(x);
+		free(y);
+		free(type);
+		free(visible);
+		free(expected);
+	}
+	return status;
+}
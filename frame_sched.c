@@ -0,0 +1,88 @@
+#include "frame_sched.h"
+#include "log.h"
+#include "render.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static const char present_mode_env_key[] = "AN_PRESENT_MODE";
+static const char frame_cap_env_key[] = "AN_FRAME_CAP";
+
+static const char *present_mode_names[] = {
+	[SDL_GPU_PRESENTMODE_VSYNC] = "VSYNC",
+	[SDL_GPU_PRESENTMODE_MAILBOX] = "MAILBOX",
+	[SDL_GPU_PRESENTMODE_IMMEDIATE] = "IMMEDIATE",
+};
+
+static SDL_GPUPresentMode present_mode_from_env(void)
+{
+	char *mode_env = getenv(present_mode_env_key);
+	if (!mode_env)
+		return SDL_GPU_PRESENTMODE_VSYNC;
+
+	for (size_t i = 0; i < SDL_arraysize(present_mode_names); ++i) {
+		if (present_mode_names[i] &&
+		    strcmp(mode_env, present_mode_names[i]) == 0)
+			return (SDL_GPUPresentMode)i;
+	}
+	log_warn("unknown %s %s, using VSYNC", present_mode_env_key, mode_env);
+	return SDL_GPU_PRESENTMODE_VSYNC;
+}
+
+// 0 if the display doesn't report one
+static float display_refresh_rate(void)
+{
+	SDL_DisplayID display = SDL_GetDisplayForWindow(rend_info.window);
+	const SDL_DisplayMode *mode =
+		display ? SDL_GetCurrentDisplayMode(display) : NULL;
+	return mode ? mode->refresh_rate : 0.0f;
+}
+
+void frame_sched_init(struct frame_sched *sched)
+{
+	*sched = (struct frame_sched){ 0 };
+	sched->present_mode = render_set_present_mode(present_mode_from_env());
+
+	// vsync paces itself, mailbox would otherwise render frames that
+	// never get shown
+	float cap_hz = 0.0f;
+	if (sched->present_mode == SDL_GPU_PRESENTMODE_MAILBOX)
+		cap_hz = display_refresh_rate();
+
+	char *cap_env = getenv(frame_cap_env_key);
+	if (cap_env) {
+		char *end;
+		float env_hz = strtof(cap_env, &end);
+		if (end == cap_env || *end != '\0' || env_hz < 0.0f)
+			log_warn("invalid %s %s, ignored", frame_cap_env_key,
+				 cap_env);
+		else
+			cap_hz = env_hz;
+	}
+
+	if (cap_hz > 0.0f)
+		sched->period_ns = (uint64_t)(SDL_NS_PER_SECOND / cap_hz);
+	sched->next_ns = SDL_GetTicksNS() + sched->period_ns;
+
+	log_info("present mode %s, frame cap %.1f hz",
+		 present_mode_names[sched->present_mode], cap_hz);
+}
+
+void frame_sched_wait(struct frame_sched *sched)
+{
+	++sched->frames;
+	if (!sched->period_ns)
+		return;
+
+	uint64_t now = SDL_GetTicksNS();
+	if (now < sched->next_ns) {
+		SDL_DelayNS(sched->next_ns - now);
+		sched->next_ns += sched->period_ns;
+	} else if (now - sched->next_ns > sched->period_ns) {
+		// more than a frame behind, e.g. after a stall. restart the
+		// schedule from now instead of rushing frames to catch up
+		sched->next_ns = now + sched->period_ns;
+	} else {
+		sched->next_ns += sched->period_ns;
+	}
+}
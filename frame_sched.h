@@ -0,0 +1,31 @@
+#ifndef FRAME_SCHED_H
+#define FRAME_SCHED_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <SDL3/SDL.h>
+
+// paces the main loop to one render per frame. all events, turns and
+// responses of a frame are folded into that single render_draw().
+// under vsync acquiring the swapchain texture already waits for the display,
+// the other present modes are held to a frame cap instead
+//
+// AN_PRESENT_MODE=VSYNC|MAILBOX|IMMEDIATE picks the present mode, vsync by
+// default. AN_FRAME_CAP=<hz> caps the frame rate, 0 for no cap. without it
+// mailbox is capped to the display refresh rate and the others are uncapped
+
+struct frame_sched {
+	SDL_GPUPresentMode present_mode;
+	uint64_t period_ns; // 0 if uncapped
+	uint64_t next_ns; // when the next frame may start
+	uint64_t frames;
+};
+
+// call after render_init(), applies the present mode
+void frame_sched_init(struct frame_sched *sched);
+
+// call once per frame after rendering, sleeps off the rest of the frame
+void frame_sched_wait(struct frame_sched *sched);
+
+#endif
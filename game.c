@@ -15,15 +15,14 @@ void game_update_time(struct game_context *ctx)
 	ctx->time.dt = (ctx->time.cur_tick - ctx->time.last_tick) / 1000.0;
 }
 
-void print_map_pos_info(struct map_pos_info *visible_map, size_t map_size)
+void print_map_cells(const struct map_cells *cells)
 {
-	if (!visible_map)
+	if (!cells || !log_enabled(LOG_TRACE))
 		return;
-	log_trace("printing map pos:");
-	for (int i = 0; i < map_size; ++i) {
-		log_trace("i: %d, (x,y): (%f,%f), type: %d", i,
-			  visible_map[i].coord.x, visible_map[i].coord.y,
-			  visible_map[i].type);
+	log_trace("printing map cells:");
+	for (int i = 0; i < cells->count; ++i) {
+		log_trace("i: %d, (x,y): (%d,%d), type: %d", i, cells->x[i],
+			  cells->y[i], cells->type[i]);
 	}
 }
 
@@ -57,29 +56,63 @@ static const enum move_direction shift_to_move_dir[3][3] = {
 	{ MOVE_SW, MOVE_S, MOVE_SE }
 };
 
-struct turn *update_player_pos(struct player *player, double dt)
+// TODO flip these to match map convention, or just handle conversion here
+// (ok to have differing render vs game conventions)
+// 0.5f shift aligns moves with tile *edges*, whereas renderer displaces relative *centers*
+int camera_tile_x(const struct camera *cam)
 {
-	struct turn *turn = NULL;
+	return (int)(cam->pos[2] - 0.5f);
+}
+
+int camera_tile_y(const struct camera *cam)
+{
+	return (int)(cam->pos[0] - 0.5f);
+}
+
+void player_move_to(struct player *player, int x, int y)
+{
+	player->camera.pos[2] = x + 1.0f;
+	player->camera.pos[0] = y + 1.0f;
+	player->pos_x = x;
+	player->pos_y = y;
+}
+
+// staying within the current tile is always allowed, so a wall turning up
+// under the player can't trap them
+static bool camera_tile_open(const struct player *player,
+			     const struct map_model *map)
+{
+	int x = camera_tile_x(&player->camera);
+	int y = camera_tile_y(&player->camera);
+	return (x == player->pos_x && y == player->pos_y) ||
+	       map_passable(map, x, y);
+}
 
+bool update_player_pos(struct player *player, const struct map_model *map,
+		       double dt, struct turn *turn)
+{
 	struct camera *cam = &player->camera;
 	float dx = player->vel_y * cos(cam->theta) +
 		   player->vel_x * cos(M_PI_2 - cam->theta);
 	float dy = -player->vel_y * cos(M_PI_2 - cam->theta) +
 		   player->vel_x * cos(cam->theta);
 
+	// one axis at a time, so a blocked axis slides along the wall
+	// instead of stopping the player
+	float old_pos = cam->pos[0];
 	cam->pos[0] += dt * dx;
+	if (!camera_tile_open(player, map))
+		cam->pos[0] = old_pos;
+	old_pos = cam->pos[2];
 	cam->pos[2] += dt * dy;
+	if (!camera_tile_open(player, map))
+		cam->pos[2] = old_pos;
 
-	// add collision detection, and conversion to game loc + emit turn if needed
+	// conversion to game loc + emit turn if needed
 	int old_pos_x = player->pos_x;
 	int old_pos_y = player->pos_y;
-	// TODO flip these to match map convention, or just handle conversion here 
-	// (ok to have differing render vs game conventions)
-	// player->pos_x = (int)cam->pos[0];
-	// player->pos_y = (int)cam->pos[2];
-	// 0.5f shift aligns moves with tile *edges*, whereas renderer displaces relative *centers*
-	player->pos_x = (int)(cam->pos[2] - 0.5f);
-	player->pos_y = (int)(cam->pos[0] - 0.5f);
+	player->pos_x = camera_tile_x(cam);
+	player->pos_y = camera_tile_y(cam);
 
 	int x_shift = player->pos_x - old_pos_x;
 	int y_shift = player->pos_y - old_pos_y;
@@ -88,12 +121,11 @@ struct turn *update_player_pos(struct player *player, double dt)
 	// translate shift into move
 	log_trace("x_shift: %d, y_shift: %d", x_shift, y_shift);
 	enum move_direction move = shift_to_move_dir[x_shift + 1][y_shift + 1];
-	if (move != MOVE_NONE) {
-		// set up move turn
-		// TODO: how to handle diagonal movement, two tile crosses very rapidly could annoy player
-		turn = malloc(sizeof(struct turn));
-		*turn = (struct turn){ .type = TURN_MOVE, .value.move = move };
-	}
+	if (move == MOVE_NONE)
+		return false;
 
-	return turn;
+	// set up move turn
+	// TODO: how to handle diagonal movement, two tile crosses very rapidly could annoy player
+	*turn = (struct turn){ .type = TURN_MOVE, .value.move = move };
+	return true;
 }
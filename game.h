@@ -2,6 +2,9 @@
 #define GAME_H
 
 #include "cglm/include/cglm/cglm.h"
+#include "map.h"
+
+struct turn;
 
 #include <stddef.h>
 #include <stdbool.h>
@@ -35,34 +38,20 @@ struct player {
 
 // player or just its camera? view can be camera only, pos needs to do extra work
 void update_player_view(struct player *player, float mouse_dx, float mouse_dy);
-// do collision detection here:
-struct turn *update_player_pos(struct player *player, double dt);
+// moves the camera, sliding along walls of the cached map. fills in *turn and
+// returns true when the player crossed into another tile
+bool update_player_pos(struct player *player, const struct map_model *map,
+		       double dt, struct turn *turn);
+
+// game tile the camera is over
+int camera_tile_x(const struct camera *cam);
+int camera_tile_y(const struct camera *cam);
+// put the camera in the middle of a tile, keeping its height and view
+void player_move_to(struct player *player, int x, int y);
 
 // DCSS defaults to 15x15 square LOS for most species, use for now
 #define MAX_MAP_VISIBLE 225
 
-// use MTYPE_NONE as nonvisible tile. can use first instance to terminate visible_map list
-// maybe too complicated, for now just set all MAX_MAP_VISIBLE to MTYPE_NONE, then skip shader output if so
-enum map_type {
-	MTYPE_NONE,
-	MTYPE_WALL,
-	MTYPE_FLOOR,
-	MTYPE_UNEXPLORED,
-	MTYPE_UNKNOWN,
-	MTYPE_COUNT
-};
-
-// does dcss have negative coords or is 0 at corner?
-struct map_coord {
-	float x, y;
-};
-
-struct map_pos_info {
-	struct map_coord coord;
-	enum map_type type;
-	// etc.
-};
-
 // to measure time difference for steady velocity:
 // dt seconds elapsed since last frame
 struct game_time {
@@ -73,16 +62,15 @@ struct game_time {
 };
 
 struct game_context {
-	struct map_pos_info visible_map[MAX_MAP_VISIBLE];
+	struct map_model map;
 	struct player *player;
 	struct game_time time;
-	// means this frame loop update everything again for the new layout,
-	// otherwise skip assume same as before:
+	// demo: reload the dummy map this frame
 	bool map_needs_change;
 };
 
 void game_update_time(struct game_context *ctx);
 
-void print_map_pos_info(struct map_pos_info *visible_map, size_t map_size);
+void print_map_cells(const struct map_cells *cells);
 
 #endif
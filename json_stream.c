@@ -0,0 +1,238 @@
+#include "json_stream.h"
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+void json_init(struct json_cursor *c, const char *data, size_t len)
+{
+	*c = (struct json_cursor){ .p = data, .end = data + len };
+}
+
+static bool fail(struct json_cursor *c)
+{
+	c->error = true;
+	return false;
+}
+
+static void skip_ws(struct json_cursor *c)
+{
+	while (c->p < c->end && (*c->p == ' ' || *c->p == '\n' ||
+				 *c->p == '\r' || *c->p == '\t'))
+		++c->p;
+}
+
+char json_peek(struct json_cursor *c)
+{
+	skip_ws(c);
+	if (c->error || c->p == c->end)
+		return '\0';
+	return *c->p;
+}
+
+static bool consume(struct json_cursor *c, char ch)
+{
+	if (json_peek(c) != ch)
+		return fail(c);
+	++c->p;
+	return true;
+}
+
+static bool push(struct json_cursor *c, char open)
+{
+	if (c->depth == JSON_STREAM_MAX_DEPTH || !consume(c, open))
+		return fail(c);
+	c->first_mask |= (uint64_t)1 << c->depth;
+	++c->depth;
+	return true;
+}
+
+// shared by objects and arrays: false at the closing char, otherwise
+// consumes the ',' separating this member from the previous one
+static bool next_member(struct json_cursor *c, char close)
+{
+	if (c->error || c->depth == 0)
+		return false;
+	uint64_t first_bit = (uint64_t)1 << (c->depth - 1);
+	char ch = json_peek(c);
+	if (ch == close) {
+		++c->p;
+		--c->depth;
+		return false;
+	}
+	if (c->first_mask & first_bit)
+		c->first_mask &= ~first_bit;
+	else if (!consume(c, ','))
+		return false;
+	return true;
+}
+
+bool json_object_begin(struct json_cursor *c)
+{
+	return push(c, '{');
+}
+
+bool json_object_next(struct json_cursor *c, struct json_str *key)
+{
+	if (!next_member(c, '}'))
+		return false;
+	return json_read_string(c, key) && consume(c, ':');
+}
+
+bool json_array_begin(struct json_cursor *c)
+{
+	return push(c, '[');
+}
+
+bool json_array_next(struct json_cursor *c)
+{
+	return next_member(c, ']');
+}
+
+bool json_read_string(struct json_cursor *c, struct json_str *out)
+{
+	if (!consume(c, '"'))
+		return false;
+	const char *start = c->p;
+	while (c->p < c->end && *c->p != '"') {
+		// skip the escaped char, so \" doesn't end the string
+		if (*c->p == '\\')
+			++c->p;
+		++c->p;
+	}
+	if (c->p >= c->end)
+		return fail(c);
+	*out = (struct json_str){ .s = start, .len = c->p - start };
+	++c->p;
+	return true;
+}
+
+static bool is_digit(char ch)
+{
+	return ch >= '0' && ch <= '9';
+}
+
+// length of the number literal at the cursor, 0 if there isn't one
+static size_t number_len(const struct json_cursor *c, bool *is_integer)
+{
+	const char *p = c->p;
+	*is_integer = true;
+	if (p < c->end && *p == '-')
+		++p;
+	const char *digits = p;
+	while (p < c->end && is_digit(*p))
+		++p;
+	if (p == digits)
+		return 0;
+	while (p < c->end && (is_digit(*p) || *p == '.' || *p == 'e' ||
+			      *p == 'E' || *p == '+' || *p == '-')) {
+		*is_integer = false;
+		++p;
+	}
+	return p - c->p;
+}
+
+bool json_read_int(struct json_cursor *c, int *out)
+{
+	json_peek(c);
+	bool is_integer;
+	size_t len = number_len(c, &is_integer);
+	if (!len)
+		return fail(c);
+	// e.g. 1.0 or 1e2, as long as the value is a whole number
+	if (!is_integer) {
+		double val;
+		if (!json_read_number(c, &val))
+			return false;
+		if (!(val >= INT_MIN && val <= INT_MAX) || (double)(int)val != val)
+			return fail(c);
+		*out = (int)val;
+		return true;
+	}
+
+	const char *p = c->p;
+	bool negative = *p == '-';
+	if (negative)
+		++p;
+	long long val = 0;
+	for (; p < c->p + len; ++p) {
+		val = val * 10 + (*p - '0');
+		if (val > INT_MAX)
+			return fail(c);
+	}
+	*out = negative ? (int)-val : (int)val;
+	c->p += len;
+	return true;
+}
+
+bool json_read_number(struct json_cursor *c, double *out)
+{
+	json_peek(c);
+	bool is_integer;
+	size_t len = number_len(c, &is_integer);
+	// the buffer isn't '\0'-terminated, so strtod needs its own copy
+	char num[64];
+	if (!len || len >= sizeof(num))
+		return fail(c);
+	memcpy(num, c->p, len);
+	num[len] = '\0';
+	char *num_end;
+	*out = strtod(num, &num_end);
+	if (num_end != num + len)
+		return fail(c);
+	c->p += len;
+	return true;
+}
+
+static bool skip_literal(struct json_cursor *c, const char *lit)
+{
+	size_t len = strlen(lit);
+	if ((size_t)(c->end - c->p) < len || memcmp(c->p, lit, len) != 0)
+		return fail(c);
+	c->p += len;
+	return true;
+}
+
+bool json_skip(struct json_cursor *c)
+{
+	struct json_str str;
+	bool is_integer;
+	size_t len;
+	switch (json_peek(c)) {
+	case '{': {
+		if (!json_object_begin(c))
+			return false;
+		while (json_object_next(c, &str))
+			if (!json_skip(c))
+				return false;
+		return !c->error;
+	}
+	case '[': {
+		if (!json_array_begin(c))
+			return false;
+		while (json_array_next(c))
+			if (!json_skip(c))
+				return false;
+		return !c->error;
+	}
+	case '"':
+		return json_read_string(c, &str);
+	case 't':
+		return skip_literal(c, "true");
+	case 'f':
+		return skip_literal(c, "false");
+	case 'n':
+		return skip_literal(c, "null");
+	default:
+		// no need to convert a number nobody reads
+		if (!(len = number_len(c, &is_integer)))
+			return fail(c);
+		c->p += len;
+		return true;
+	}
+}
+
+bool json_str_eq(struct json_str str, const char *lit)
+{
+	return strlen(lit) == str.len && memcmp(str.s, lit, str.len) == 0;
+}
@@ -0,0 +1,57 @@
+#ifndef JSON_STREAM_H
+#define JSON_STREAM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// single-pass pull parser over a json buffer that need not be '\0'-terminated.
+// values are read or skipped in place as the cursor walks the text, nothing
+// is allocated. strings are handed out as raw views, escapes left undecoded.
+// any syntax error sets cursor.error, after which every call fails
+
+#define JSON_STREAM_MAX_DEPTH 64
+
+struct json_cursor {
+	const char *p;
+	const char *end;
+	// bit per open container: set until its first member has been read
+	uint64_t first_mask;
+	int depth;
+	bool error;
+};
+
+struct json_str {
+	const char *s;
+	size_t len;
+};
+
+void json_init(struct json_cursor *c, const char *data, size_t len);
+
+// next non-whitespace char without consuming it, '\0' at the end
+char json_peek(struct json_cursor *c);
+
+// usage:
+//   if (json_object_begin(c))
+//     while (json_object_next(c, &key))
+//       read or json_skip() the value
+// json_object_next() returns false at the closing '}' (or on error)
+bool json_object_begin(struct json_cursor *c);
+bool json_object_next(struct json_cursor *c, struct json_str *key);
+
+// as above, json_array_next() leaves the cursor at the next element
+bool json_array_begin(struct json_cursor *c);
+bool json_array_next(struct json_cursor *c);
+
+bool json_read_string(struct json_cursor *c, struct json_str *out);
+bool json_read_number(struct json_cursor *c, double *out);
+// also takes fraction or exponent forms of whole numbers, e.g. 1.0, and
+// fails for anything else that isn't an int
+bool json_read_int(struct json_cursor *c, int *out);
+
+// skip over the next value of any type, including nested containers
+bool json_skip(struct json_cursor *c);
+
+bool json_str_eq(struct json_str str, const char *lit);
+
+#endif
@@ -7,8 +7,6 @@
 #include <string.h>
 #include <unistd.h>
 
-enum log_level { LOG_NONE, LOG_ERR, LOG_WARN, LOG_INFO, LOG_TRACE };
-
 static const char *level_env_vals[] = { [LOG_NONE] = "NONE",
 					[LOG_ERR] = "ERR",
 					[LOG_WARN] = "WARN",
@@ -76,7 +74,7 @@ void log_warn_full(const char *file, const int line, const char *fmt, ...)
 	fprintf(stderr, "\n");
 }
 
-void log_info(const char *fmt, ...)
+void log_info_full(const char *fmt, ...)
 {
 	if (log_level < LOG_INFO)
 		return;
@@ -91,7 +89,7 @@ void log_info(const char *fmt, ...)
 	fprintf(stderr, "\n");
 }
 
-void log_trace(const char *fmt, ...)
+void log_trace_full(const char *fmt, ...)
 {
 	if (log_level < LOG_TRACE)
 		return;
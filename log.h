@@ -1,25 +1,48 @@
 #ifndef LOG_H
 #define LOG_H
 
+enum log_level { LOG_NONE, LOG_ERR, LOG_WARN, LOG_INFO, LOG_TRACE };
+
+extern enum log_level log_level;
+
+// the log macros test this before evaluating their arguments, so a disabled
+// log line costs one compare. guard expensive setup, e.g. serializing
+// something only to log it, with it as well
+#define log_enabled(level) (log_level >= (level))
+
 void log_err_full(const char *file, const int line, const char *fmt, ...);
 
-#define log_err(fmt, ...)                                     \
-	do {                                                  \
-		log_err_full(__FILE__, __LINE__,              \
-			     fmt __VA_OPT__(, ) __VA_ARGS__); \
+#define log_err(fmt, ...)                                             \
+	do {                                                          \
+		if (log_enabled(LOG_ERR))                             \
+			log_err_full(__FILE__, __LINE__,              \
+				     fmt __VA_OPT__(, ) __VA_ARGS__); \
 	} while (0)
 
 void log_warn_full(const char *file, const int line, const char *fmt, ...);
 
-#define log_warn(fmt, ...)                                     \
-	do {                                                   \
-		log_warn_full(__FILE__, __LINE__,              \
-			      fmt __VA_OPT__(, ) __VA_ARGS__); \
+#define log_warn(fmt, ...)                                             \
+	do {                                                           \
+		if (log_enabled(LOG_WARN))                             \
+			log_warn_full(__FILE__, __LINE__,              \
+				      fmt __VA_OPT__(, ) __VA_ARGS__); \
 	} while (0)
 
-void log_info(const char *fmt, ...);
+void log_info_full(const char *fmt, ...);
 
-void log_trace(const char *fmt, ...);
+#define log_info(fmt, ...)                                            \
+	do {                                                          \
+		if (log_enabled(LOG_INFO))                            \
+			log_info_full(fmt __VA_OPT__(, ) __VA_ARGS__); \
+	} while (0)
+
+void log_trace_full(const char *fmt, ...);
+
+#define log_trace(fmt, ...)                                             \
+	do {                                                            \
+		if (log_enabled(LOG_TRACE))                             \
+			log_trace_full(fmt __VA_OPT__(, ) __VA_ARGS__); \
+	} while (0)
 
 void log_init(void);
 
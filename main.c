@@ -1,7 +1,10 @@
+#include "frame_sched.h"
 #include "game.h"
 #include "log.h"
 #include "net_data.h"
+#include "predict.h"
 #include "render.h"
+#include "startup.h"
 #include "turn.h"
 
 #include <math.h>
@@ -16,10 +19,11 @@
 bool done = false;
 
 // handle current state of logical keyboard (infrequent at key-poll rate, not per-frame)
-struct turn *process_key(SDL_KeyboardEvent *key_event,
-			 struct game_context *game_ctx)
+// returns true if the key produced a turn in *turn
+bool process_key(SDL_KeyboardEvent *key_event, struct game_context *game_ctx,
+		 struct turn *turn)
 {
-	struct turn *turn = NULL;
+	bool has_turn = false;
 	if (key_event->type == SDL_EVENT_KEY_UP) {
 		// TODO: add shift?
 		enum frame_keys off_keys = FRAME_KEY_NONE;
@@ -43,9 +47,10 @@ struct turn *process_key(SDL_KeyboardEvent *key_event,
 			off_keys |= FRAME_KEY_LSHIFT;
 			break;
 		case SDL_SCANCODE_SPACE:
-			turn = malloc(sizeof(struct turn));
+			predict_step(MOVE_N, game_ctx);
 			*turn = (struct turn){ .type = TURN_MOVE,
 					       .value.move = MOVE_N };
+			has_turn = true;
 		default:
 			break;
 		}
@@ -75,7 +80,7 @@ struct turn *process_key(SDL_KeyboardEvent *key_event,
 		}
 		game_ctx->player->keystate |= on_keys;
 	}
-	return turn;
+	return has_turn;
 }
 
 // update state for this frame based on keyboard, mouse input
@@ -108,11 +113,11 @@ void process_frame_input(struct game_context *game_ctx)
 	update_player_view(game_ctx->player, mouse_dx, mouse_dy);
 }
 
-struct turn *process_event(SDL_Event *event, struct game_context *game_ctx)
+bool process_event(SDL_Event *event, struct game_context *game_ctx,
+		   struct turn *turn)
 {
-	struct turn *turn = NULL;
 	if (!event)
-		return turn;
+		return false;
 	switch (event->type) {
 	case SDL_EVENT_QUIT:
 		done = true;
@@ -122,7 +127,7 @@ struct turn *process_event(SDL_Event *event, struct game_context *game_ctx)
 		break;
 	case SDL_EVENT_KEY_UP:
 	case SDL_EVENT_KEY_DOWN:
-		return process_key(&event->key, game_ctx);
+		return process_key(&event->key, game_ctx, turn);
 	case SDL_EVENT_WINDOW_RESIZED:
 		if (!SDL_GetWindowSize(rend_info.window, &rend_info.win_w,
 				       &rend_info.win_h)) {
@@ -133,41 +138,81 @@ struct turn *process_event(SDL_Event *event, struct game_context *game_ctx)
 		if (!SDL_SetWindowRelativeMouseMode(rend_info.window, true)) {
 			log_err("SDL_SetWindowRelativeMouseMode error :%s",
 				SDL_GetError());
-			return turn;
+			return false;
 		}
 	default:
 		break;
 	}
-	return turn;
+	return false;
 }
 
-const static struct map_pos_info dummy_visible_map[MAX_MAP_VISIBLE] = {
-	{ { 1, 2 }, MTYPE_FLOOR },
-	{ { 1, -2 }, MTYPE_FLOOR }
+// demo floor tiles
+const static struct map_coord dummy_visible_map[] = {
+	{ 1, 2 },
+	{ 1, 6 }
 };
 
-struct turn *update_world(struct game_context *game_ctx)
+static void load_dummy_map(struct map_model *map)
 {
-	// called per frame, only expected turn is a move for tile crossing
-	struct turn *turn = NULL;
+	for (size_t i = 0; i < SDL_arraysize(dummy_visible_map); ++i)
+		map_set(map, dummy_visible_map[i].x, dummy_visible_map[i].y,
+			MTYPE_FLOOR);
+}
 
+bool update_world(struct game_context *game_ctx, struct turn *turn)
+{
+	// called per frame, only expected turn is a move for tile crossing
 	process_frame_input(game_ctx);
 
 	// update camera and move relative the pointed direction, may generate game movement turn
-	turn = update_player_pos(game_ctx->player, game_ctx->time.dt);
+	bool has_turn = update_player_pos(game_ctx->player, &game_ctx->map,
+					  game_ctx->time.dt, turn);
 
 	// update map
 	// demo
 	if (game_ctx->map_needs_change)
-		memcpy(game_ctx->visible_map, dummy_visible_map,
-		       MAX_MAP_VISIBLE * sizeof(struct map_pos_info));
+		load_dummy_map(&game_ctx->map);
+
+	return has_turn;
+}
+
+// request the initial map, answered while the frame loop already runs
+// a wait, so the player stays on the tile prediction starts from
+static const struct turn init_turn = { .type = TURN_MOVE,
+				       .value.move = MOVE_WAIT };
+static int handshake_phase = -1;
 
-	return turn;
+static void init_turn_done(const struct turn *turn, bool success,
+			   struct game_context *ctx)
+{
+	startup_end(handshake_phase);
+	if (!success)
+		log_warn("initial turn failed");
+}
+
+// connecting and sending the first turn overlap window, gpu and asset setup
+// on the main thread. the main thread only touches the network and turn
+// queue after joining this thread
+static int connect_thread_main(void *data)
+{
+	int phase = startup_begin("net connect");
+	bool connected = net_data_init();
+	startup_end(phase);
+	if (!connected)
+		return false;
+
+	handshake_phase = startup_begin("first turn");
+	if (!turn_submit(&init_turn, init_turn_done)) {
+		startup_end(handshake_phase);
+		return false;
+	}
+	return true;
 }
 
 int main(int argc, char *argv[])
 {
 	log_init();
+	startup_init();
 
 	struct player player = { 
 		.camera = { 
@@ -182,31 +227,56 @@ int main(int argc, char *argv[])
 		.keystate = FRAME_KEY_NONE 
 	};
 
-	struct game_context game_ctx = {};
+	// map model is too big to want on the stack
+	static struct game_context game_ctx = {};
+	map_init(&game_ctx.map);
 	game_ctx.player = &player;
 
+	int phase = startup_begin("sdl init");
 	if (!SDL_Init(SDL_INIT_VIDEO)) {
 		log_err("SDL_Init failure: %s", SDL_GetError());
 		return EXIT_FAILURE;
 	}
+	startup_end(phase);
 
-	if (!render_init()) {
-		log_err("render_init failure");
-		return EXIT_FAILURE;
+	// before the connect thread can submit any turn
+	predict_init(&game_ctx);
+
+	int ret = EXIT_FAILURE;
+	SDL_Thread *connect_thread =
+		SDL_CreateThread(connect_thread_main, "net_connect", NULL);
+	if (!connect_thread) {
+		log_err("SDL_CreateThread failed: %s", SDL_GetError());
+		goto quit_sdl;
 	}
 
+	phase = startup_begin("render init");
+	bool rendering = render_init();
+	if (!rendering)
+		log_err("render_init failure");
+	startup_end(phase);
+
+	// the connect thread is done with the network either way after this,
+	// so both sides can be torn down from here on
 	// todo allow running without network?
-	if (!net_data_init()) {
+	int connected;
+	SDL_WaitThread(connect_thread, &connected);
+	if (!rendering)
+		goto quit;
+	if (!connected) {
 		log_err("net_init failure");
-		return EXIT_FAILURE;
+		goto quit;
 	}
 
 	// dummy once here
-	memcpy(game_ctx.visible_map, dummy_visible_map,
-	       MAX_MAP_VISIBLE * sizeof(struct map_pos_info));
+	load_dummy_map(&game_ctx.map);
+
+	struct frame_sched sched;
+	frame_sched_init(&sched);
 
-	struct turn init_turn = { .type = TURN_MOVE, .value.move = MOVE_N };
-	do_turn(&init_turn, &game_ctx);
+	// first frame ends the timeline unless the first turn is still out
+	int first_frame_phase = startup_begin("first frame");
+	bool startup_reported = false;
 
 	while (!done) {
 		// update time
@@ -218,38 +288,51 @@ int main(int argc, char *argv[])
 
 		// process events
 		SDL_Event event;
+		struct turn turn;
 		while (SDL_PollEvent(&event)) {
-			struct turn *turn = process_event(&event, &game_ctx);
-			if (turn) {
-				// send and receive game turn
-				// process_event() may generate a turn
-				// TODO: maybe consume the turn and free within function when processing in this function?
-				do_turn(turn,
-					&game_ctx); // do_consume_turn(turn);
-				free_turn(turn);
-
-				// need to re-render game world in case double triggered with movement below
-				// do_turn will update world state too
-				if (!render_draw(&game_ctx)) {
-					log_err("render_draw failure");
-				}
-			}
+			// queue game turn, its response is applied by turn_poll() on a later frame
+			// process_event() may generate a turn
+			if (process_event(&event, &game_ctx, &turn))
+				predict_submit(&turn, &game_ctx);
 		}
 
-		// update world entities, potentially advancing game turn
-		struct turn *turn = update_world(&game_ctx);
-		if (turn) {
-			do_turn(turn, &game_ctx);
-			free_turn(turn);
-		}
+		// update world entities, potentially advancing game turn.
+		// the player has already moved, the server's answer is
+		// reconciled with that once it arrives
+		if (update_world(&game_ctx, &turn))
+			predict_submit(&turn, &game_ctx);
+
+		// send queued turns and apply any responses that have arrived, never blocks
+		turn_poll(&game_ctx);
 
-		// render
+		// render everything that changed this frame at once
 		if (!render_draw(&game_ctx)) {
 			log_err("render_draw failure");
 		}
+		if (!startup_reported) {
+			startup_end(first_frame_phase);
+			first_frame_phase = -1;
+			if (!startup_pending()) {
+				startup_dump();
+				startup_reported = true;
+			}
+		}
+
+		// every consumer has seen this frame's map changes now
+		map_clear_dirty(&game_ctx.map);
+
+		frame_sched_wait(&sched);
 	}
 
+	log_info("predicted position corrected %llu times",
+		 (unsigned long long)predict_corrections());
+	ret = EXIT_SUCCESS;
+
+quit:
+	// both cope with an init that failed part way
+	net_data_exit();
 	render_quit();
+quit_sdl:
 	SDL_Quit();
-	return EXIT_SUCCESS;
+	return ret;
 }
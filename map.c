@@ -0,0 +1,237 @@
+#include "map.h"
+#include "log.h"
+
+#include <assert.h>
+#include <string.h>
+
+static void reset_level(struct map_level *level, int id)
+{
+	level->id = id;
+	level->last_visit = 0;
+	for (int i = 0; i < MAP_LEVEL_CHUNKS; ++i)
+		level->chunk[i] = -1;
+	level->active_count = 0;
+}
+
+void map_init(struct map_model *map)
+{
+	memset(map, 0, sizeof(*map));
+	// MTYPE_NONE is 0, so every chunk starts out empty
+	for (int i = 0; i < MAP_CHUNK_POOL; ++i) {
+		map->chunks[i].level = -1;
+		map->free_chunks[i] = (int16_t)(MAP_CHUNK_POOL - 1 - i);
+	}
+	map->free_count = MAP_CHUNK_POOL;
+	for (int i = 0; i < MAP_LEVELS; ++i)
+		reset_level(&map->levels[i], -1);
+
+	map->cur = 0;
+	reset_level(&map->levels[0], 0);
+	map->levels[0].last_visit = ++map->visits;
+}
+
+static void mark_dirty(struct map_model *map, int idx)
+{
+	uint64_t bit = (uint64_t)1 << (idx % 64);
+	if (map->dirty_bits[idx / 64] & bit)
+		return;
+	map->dirty_bits[idx / 64] |= bit;
+	map->dirty[map->dirty_count++] = (uint16_t)idx;
+}
+
+static int chunk_origin_index(const struct map_chunk *chunk)
+{
+	return map_index(chunk->cx << MAP_CHUNK_SHIFT,
+			 chunk->cy << MAP_CHUNK_SHIFT);
+}
+
+// mark every non-empty cell of a level dirty
+static void mark_level_dirty(struct map_model *map, int slot)
+{
+	const struct map_level *level = &map->levels[slot];
+	for (int i = 0; i < level->active_count; ++i) {
+		const struct map_chunk *chunk = &map->chunks[level->active[i]];
+		if (!chunk->filled)
+			continue;
+		int origin = chunk_origin_index(chunk);
+		for (int c = 0; c < MAP_CHUNK_CELLS; ++c) {
+			if (chunk->type[c] == MTYPE_NONE)
+				continue;
+			mark_dirty(map, origin + (c >> MAP_CHUNK_SHIFT) * GXM +
+						(c & (MAP_CHUNK_DIM - 1)));
+		}
+	}
+}
+
+// return all of a level's chunks to the pool
+static void release_level_chunks(struct map_model *map, int slot)
+{
+	struct map_level *level = &map->levels[slot];
+	for (int i = 0; i < level->active_count; ++i) {
+		int16_t pool_idx = level->active[i];
+		struct map_chunk *chunk = &map->chunks[pool_idx];
+		memset(chunk->type, 0, sizeof(chunk->type));
+		chunk->filled = 0;
+		chunk->level = -1;
+		level->chunk[chunk->cy * MAP_CHUNKS_X + chunk->cx] = -1;
+		map->free_chunks[map->free_count++] = pool_idx;
+	}
+	level->active_count = 0;
+}
+
+// least recently visited level other than the current one, -1 if none
+static int lru_level(const struct map_model *map, bool need_chunks)
+{
+	int lru = -1;
+	for (int i = 0; i < MAP_LEVELS; ++i) {
+		const struct map_level *level = &map->levels[i];
+		if (i == map->cur || level->id < 0 ||
+		    (need_chunks && !level->active_count))
+			continue;
+		if (lru < 0 || level->last_visit < map->levels[lru].last_visit)
+			lru = i;
+	}
+	return lru;
+}
+
+static void forget_level(struct map_model *map, int slot)
+{
+	log_info("forgetting map of level %d", map->levels[slot].id);
+	release_level_chunks(map, slot);
+	reset_level(&map->levels[slot], -1);
+}
+
+void map_set_level(struct map_model *map, int level_id)
+{
+	if (map->levels[map->cur].id == level_id)
+		return;
+
+	int slot = -1;
+	int unused = -1;
+	for (int i = 0; i < MAP_LEVELS; ++i) {
+		if (map->levels[i].id == level_id)
+			slot = i;
+		else if (unused < 0 && map->levels[i].id < 0)
+			unused = i;
+	}
+	if (slot < 0) {
+		if (unused < 0) {
+			unused = lru_level(map, false);
+			forget_level(map, unused);
+		}
+		slot = unused;
+		reset_level(&map->levels[slot], level_id);
+	}
+
+	// old cells disappear and new ones appear, both need redrawing
+	mark_level_dirty(map, map->cur);
+	map->cur = slot;
+	map->levels[slot].last_visit = ++map->visits;
+	mark_level_dirty(map, map->cur);
+}
+
+// chunk holding (x,y) on the current level, allocated if create is set.
+// NULL if not allocated (or the pool is exhausted)
+static struct map_chunk *level_chunk(struct map_model *map, int x, int y,
+				     bool create)
+{
+	struct map_level *level = &map->levels[map->cur];
+	int cx = x >> MAP_CHUNK_SHIFT;
+	int cy = y >> MAP_CHUNK_SHIFT;
+	int16_t pool_idx = level->chunk[cy * MAP_CHUNKS_X + cx];
+	if (pool_idx >= 0)
+		return &map->chunks[pool_idx];
+	if (!create)
+		return NULL;
+
+	if (map->free_count == 0) {
+		int lru = lru_level(map, true);
+		if (lru < 0) {
+			log_err("map chunk pool exhausted");
+			return NULL;
+		}
+		forget_level(map, lru);
+	}
+
+	pool_idx = map->free_chunks[--map->free_count];
+	struct map_chunk *chunk = &map->chunks[pool_idx];
+	chunk->level = map->cur;
+	chunk->cx = cx;
+	chunk->cy = cy;
+	level->chunk[cy * MAP_CHUNKS_X + cx] = pool_idx;
+	level->active[level->active_count++] = pool_idx;
+	return chunk;
+}
+
+static int chunk_cell(int x, int y)
+{
+	return (y & (MAP_CHUNK_DIM - 1)) * MAP_CHUNK_DIM +
+	       (x & (MAP_CHUNK_DIM - 1));
+}
+
+bool map_set(struct map_model *map, int x, int y, enum map_type type)
+{
+	if (!map_in_bounds(x, y)) {
+		log_warn("ignoring out of bounds cell (%d,%d)", x, y);
+		return false;
+	}
+	// don't allocate a chunk just to store nothing in it
+	struct map_chunk *chunk = level_chunk(map, x, y, type != MTYPE_NONE);
+	if (!chunk)
+		return false;
+
+	uint8_t *cell = &chunk->type[chunk_cell(x, y)];
+	if (*cell == type)
+		return false;
+	chunk->filled += (*cell == MTYPE_NONE) - (type == MTYPE_NONE);
+	*cell = (uint8_t)type;
+	mark_dirty(map, map_index(x, y));
+	return true;
+}
+
+enum map_type map_get(const struct map_model *map, int x, int y)
+{
+	if (!map_in_bounds(x, y))
+		return MTYPE_NONE;
+	const struct map_level *level = &map->levels[map->cur];
+	int16_t pool_idx = level->chunk[(y >> MAP_CHUNK_SHIFT) * MAP_CHUNKS_X +
+					(x >> MAP_CHUNK_SHIFT)];
+	if (pool_idx < 0)
+		return MTYPE_NONE;
+	return (enum map_type)map->chunks[pool_idx].type[chunk_cell(x, y)];
+}
+
+enum map_type map_get_index(const struct map_model *map, int idx)
+{
+	return map_get(map, map_index_x(idx), map_index_y(idx));
+}
+
+bool map_passable(const struct map_model *map, int x, int y)
+{
+	return map_in_bounds(x, y) && !map_type_solid(map_get(map, x, y));
+}
+
+void map_clear(struct map_model *map)
+{
+	mark_level_dirty(map, map->cur);
+	release_level_chunks(map, map->cur);
+}
+
+int map_chunk_count(const struct map_model *map)
+{
+	return map->levels[map->cur].active_count;
+}
+
+const struct map_chunk *map_chunk_at(const struct map_model *map, int i)
+{
+	assert(i >= 0 && i < map_chunk_count(map));
+	return &map->chunks[map->levels[map->cur].active[i]];
+}
+
+void map_clear_dirty(struct map_model *map)
+{
+	// only touch the words that have bits set
+	for (int i = 0; i < map->dirty_count; ++i)
+		map->dirty_bits[map->dirty[i] / 64] = 0;
+	map->dirty_count = 0;
+}
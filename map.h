@@ -0,0 +1,147 @@
+#ifndef MAP_H
+#define MAP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// use MTYPE_NONE as empty/never seen cell, the renderer skips those
+enum map_type {
+	MTYPE_NONE,
+	MTYPE_WALL,
+	MTYPE_FLOOR,
+	MTYPE_UNEXPLORED,
+	MTYPE_UNKNOWN,
+	MTYPE_COUNT
+};
+
+// does dcss have negative coords or is 0 at corner?
+// ^ 0 at corner, cells are in [0, GXM) x [0, GYM)
+struct map_coord {
+	int16_t x, y;
+};
+
+// batch of cells as parallel streams, so a pass over one field reads
+// contiguous memory
+#define MAP_BATCH_CELLS 256
+struct map_cells {
+	int16_t x[MAP_BATCH_CELLS];
+	int16_t y[MAP_BATCH_CELLS];
+	uint8_t type[MAP_BATCH_CELLS]; // enum map_type
+	int count;
+	// etc.
+};
+
+// dcss level size, see GXM/GYM in crawl's defines.h
+#define GXM 80
+#define GYM 70
+#define MAP_CELLS (GXM * GYM)
+
+// levels are stored as a grid of fixed-size chunks, allocated from a shared
+// pool the first time one of their cells is set
+#define MAP_CHUNK_SHIFT 4
+#define MAP_CHUNK_DIM (1 << MAP_CHUNK_SHIFT)
+#define MAP_CHUNK_CELLS (MAP_CHUNK_DIM * MAP_CHUNK_DIM)
+#define MAP_CHUNKS_X ((GXM + MAP_CHUNK_DIM - 1) / MAP_CHUNK_DIM)
+#define MAP_CHUNKS_Y ((GYM + MAP_CHUNK_DIM - 1) / MAP_CHUNK_DIM)
+#define MAP_LEVEL_CHUNKS (MAP_CHUNKS_X * MAP_CHUNKS_Y)
+
+// levels remembered at once
+#define MAP_LEVELS 16
+// chunks shared by all levels, enough for a few fully explored ones. when it
+// runs out the least recently visited level is forgotten
+#define MAP_CHUNK_POOL (4 * MAP_LEVEL_CHUNKS)
+
+struct map_chunk {
+	uint8_t type[MAP_CHUNK_CELLS]; // enum map_type, row major in the chunk
+	int filled; // non-empty cells
+	int level; // owning level slot, -1 while in the free pool
+	int cx, cy; // position in the level's chunk grid
+};
+
+struct map_level {
+	int id; // caller's level id, -1 if the slot is unused
+	uint64_t last_visit;
+	int16_t chunk[MAP_LEVEL_CHUNKS]; // pool index, -1 if not allocated
+	// allocated chunks, so iterating a level skips empty space
+	int16_t active[MAP_LEVEL_CHUNKS];
+	int active_count;
+};
+
+// persistent model of every level seen so far. the server only sends cells
+// that changed, so updates are applied in place. every changed cell of the
+// current level is recorded once in the dirty set, letting the renderer and
+// game logic work on just the changes instead of rescanning the whole map
+struct map_model {
+	struct map_chunk chunks[MAP_CHUNK_POOL];
+	int16_t free_chunks[MAP_CHUNK_POOL];
+	int free_count;
+	struct map_level levels[MAP_LEVELS];
+	int cur; // current level slot
+	uint64_t visits;
+
+	// current level cells (see map_index()) changed since the last
+	// map_clear_dirty(), in order of change
+	uint16_t dirty[MAP_CELLS];
+	int dirty_count;
+	uint64_t dirty_bits[(MAP_CELLS + 63) / 64];
+};
+
+static inline bool map_in_bounds(int x, int y)
+{
+	return x >= 0 && x < GXM && y >= 0 && y < GYM;
+}
+
+static inline int map_index(int x, int y)
+{
+	return y * GXM + x;
+}
+
+static inline int map_index_x(int idx)
+{
+	return idx % GXM;
+}
+
+static inline int map_index_y(int idx)
+{
+	return idx / GXM;
+}
+
+// blocks movement and is drawn as a solid block. walls and cells the server
+// reports but hasn't shown yet, never seen (MTYPE_NONE) cells are open
+static inline bool map_type_solid(enum map_type type)
+{
+	return type != MTYPE_NONE && type != MTYPE_FLOOR;
+}
+
+// starts on level id 0
+void map_init(struct map_model *map);
+
+// switch the current level, keeping what was seen of the old one. every
+// non-empty cell of both levels is marked dirty
+void map_set_level(struct map_model *map, int level_id);
+
+// all of these act on the current level
+
+// returns true if the cell changed (and was marked dirty).
+// out of bounds cells are ignored
+bool map_set(struct map_model *map, int x, int y, enum map_type type);
+
+enum map_type map_get(const struct map_model *map, int x, int y);
+enum map_type map_get_index(const struct map_model *map, int idx);
+
+// whether the player may step onto the cell as far as the cached map knows,
+// see map_type_solid(). the server has the final say
+bool map_passable(const struct map_model *map, int x, int y);
+
+// forget every cell. marks the non-empty ones dirty
+void map_clear(struct map_model *map);
+
+// allocated chunks of the current level, for i in [0, map_chunk_count())
+int map_chunk_count(const struct map_model *map);
+const struct map_chunk *map_chunk_at(const struct map_model *map, int i);
+
+// call once every consumer has seen this frame's changes
+void map_clear_dirty(struct map_model *map);
+
+#endif
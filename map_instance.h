@@ -0,0 +1,38 @@
+#ifndef MAP_INSTANCE_H
+#define MAP_INSTANCE_H
+
+#include "map.h"
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// per instance vertex data of position_color_shifted.vert, the shader works
+// out the world position from the tile coords and the color from the palette.
+// cull_tiles.comp reads the same layout as two words, see
+// map_instance_check.c
+struct gpu_map_instance {
+	int16_t x, y; // map cell, SHORT2 attribute
+	uint8_t type; // enum map_type, indexes the palette. UBYTE4 attribute
+	uint8_t flags; // unused for now
+	uint16_t pad;
+};
+_Static_assert(sizeof(struct gpu_map_instance) == 8,
+	       "shader reads 8 byte map instances");
+_Static_assert(offsetof(struct gpu_map_instance, type) == 4,
+	       "shader reads type from the second word");
+_Static_assert(MTYPE_COUNT <= UINT8_MAX, "map type doesn't fit a byte");
+
+static inline struct gpu_map_instance pack_map_instance(int x, int y,
+							 enum map_type type)
+{
+	assert(x >= INT16_MIN && x <= INT16_MAX);
+	assert(y >= INT16_MIN && y <= INT16_MAX);
+	return (struct gpu_map_instance){
+		.x = (int16_t)x,
+		.y = (int16_t)y,
+		.type = (uint8_t)type,
+	};
+}
+
+#endif
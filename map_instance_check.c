@@ -0,0 +1,89 @@
+// packs map instances the way render.c uploads them and decodes them both
+// with the arithmetic of cull_tiles.comp.hlsl and the way the vertex fetch
+// reads the instance attributes of position_color_shifted.vert.hlsl, checking
+// the coords survive the int16 round trip with their sign. registered as a
+// ctest
+#include "map_instance.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+static const int coords[] = { 0, 1, -1, 2, -2, GXM - 1, GYM - 1, 255, -256,
+			      32767, -32767, INT16_MIN };
+
+struct decoded {
+	int x, y, type, flags;
+};
+
+// tiles.Load2(8 * i) on a little endian ByteAddressBuffer
+static struct decoded decode_like_shader(const struct gpu_map_instance *inst)
+{
+	const unsigned char *b = (const unsigned char *)inst;
+	uint32_t elem_x = b[0] | b[1] << 8 | b[2] << 16 | (uint32_t)b[3] << 24;
+	uint32_t elem_y = b[4] | b[5] << 8 | b[6] << 16 | (uint32_t)b[7] << 24;
+
+	// int map_x = (int)(elem.x << 16) >> 16;
+	// int map_y = (int)elem.x >> 16;
+	// int type = elem.y & 0xff;
+	return (struct decoded){ .x = (int32_t)(elem_x << 16) >> 16,
+				 .y = (int32_t)elem_x >> 16,
+				 .type = elem_y & 0xff };
+}
+
+// the attribute offsets and formats render.c gives the map pipeline
+#define TILE_ATTR_OFFSET offsetof(struct gpu_map_instance, x) // SHORT2
+#define TYPE_ATTR_OFFSET offsetof(struct gpu_map_instance, type) // UBYTE4
+
+// int2 tile : TEXCOORD1 gets two sign extended little endian int16s,
+// uint4 type_flags : TEXCOORD2 four zero extended bytes, type in .x and
+// flags in .y
+static struct decoded decode_like_vertex_fetch(
+	const struct gpu_map_instance *inst)
+{
+	const unsigned char *tile = (const unsigned char *)inst +
+				    TILE_ATTR_OFFSET;
+	const unsigned char *type_flags = (const unsigned char *)inst +
+					  TYPE_ATTR_OFFSET;
+	return (struct decoded){ .x = (int16_t)(tile[0] | tile[1] << 8),
+				 .y = (int16_t)(tile[2] | tile[3] << 8),
+				 .type = type_flags[0],
+				 .flags = type_flags[1] };
+}
+
+int main(void)
+{
+	int failures = 0;
+	int checked = 0;
+	for (size_t i = 0; i < sizeof(coords) / sizeof(coords[0]); ++i) {
+		for (size_t j = 0; j < sizeof(coords) / sizeof(coords[0]); ++j) {
+			for (int type = 0; type < MTYPE_COUNT; ++type) {
+				// the upload buffer may hold anything before
+				struct gpu_map_instance inst;
+				memset(&inst, 0xa5, sizeof(inst));
+				inst = pack_map_instance(coords[i], coords[j],
+							 type);
+
+				struct decoded cull = decode_like_shader(&inst);
+				struct decoded vert =
+					decode_like_vertex_fetch(&inst);
+				++checked;
+				if (cull.x == coords[i] && cull.y == coords[j] &&
+				    cull.type == type && vert.x == coords[i] &&
+				    vert.y == coords[j] && vert.type == type &&
+				    vert.flags == 0)
+					continue;
+				++failures;
+				printf("packed (%d,%d) type %d, cull pass decoded (%d,%d) type %d, vertex fetch (%d,%d) type %d flags %d\n",
+				       coords[i], coords[j], type, cull.x,
+				       cull.y, cull.type, vert.x, vert.y,
+				       vert.type, vert.flags);
+			}
+		}
+	}
+
+	printf("%d of %d map instances round trip\n", checked - failures,
+	       checked);
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,202 @@
+#include "mesher.h"
+
+#include <float.h>
+#include <string.h>
+
+// world y of the faces, see map_tile_center()
+#define SOLID_TOP 1.0f
+#define SOLID_BOTTOM -1.0f
+#define FLOOR_TOP -1.0f
+#define FLOOR_BOTTOM -3.0f
+
+// map coords are continuous here, cell centers sit on integers
+static void map_to_world(float x, float y, float world_y, vec3 dest)
+{
+	dest[0] = y * -2.0f + 0.5f;
+	dest[1] = world_y;
+	dest[2] = x * 2.0f + 0.5f;
+}
+
+// corners in order around the quad, either way round. the winding is fixed
+// up so the quad is counter-clockwise seen from the side normal points to
+static void emit_quad(struct terrain_mesh *mesh, vec3 corners[4],
+		      const vec3 normal, enum map_type type)
+{
+	uint16_t base = (uint16_t)mesh->num_vertices;
+	for (int i = 0; i < 4; ++i) {
+		struct terrain_vertex *v = &mesh->vertices[mesh->num_vertices++];
+		glm_vec3_copy(corners[i], v->pos);
+		v->type = type;
+		for (int a = 0; a < 3; ++a) {
+			if (corners[i][a] < mesh->min[a])
+				mesh->min[a] = corners[i][a];
+			if (corners[i][a] > mesh->max[a])
+				mesh->max[a] = corners[i][a];
+		}
+	}
+
+	vec3 e1, e2, cross;
+	glm_vec3_sub(corners[1], corners[0], e1);
+	glm_vec3_sub(corners[2], corners[0], e2);
+	glm_vec3_cross(e1, e2, cross);
+	bool ccw = glm_vec3_dot(cross, (float *)normal) > 0.0f;
+
+	static const uint16_t ccw_order[6] = { 0, 1, 2, 0, 2, 3 };
+	static const uint16_t cw_order[6] = { 0, 2, 1, 0, 3, 2 };
+	const uint16_t *order = ccw ? ccw_order : cw_order;
+	for (int i = 0; i < 6; ++i)
+		mesh->indices[mesh->num_indices++] = base + order[i];
+}
+
+// merge equal non-zero entries of mask into rectangles, each emitted as
+// (u, v, w, h, type). rows are only merged if merge_rows is set, side faces
+// of different slices lie in different planes
+typedef void (*rect_fn)(struct terrain_mesh *mesh, const void *data, int u,
+			int v, int w, int h, enum map_type type);
+
+static void greedy_merge(uint8_t mask[MAP_CHUNK_DIM][MAP_CHUNK_DIM],
+			 bool merge_rows, rect_fn emit,
+			 struct terrain_mesh *mesh, const void *data)
+{
+	for (int v = 0; v < MAP_CHUNK_DIM; ++v) {
+		for (int u = 0; u < MAP_CHUNK_DIM; ++u) {
+			uint8_t type = mask[v][u];
+			if (!type)
+				continue;
+
+			int w = 1;
+			while (u + w < MAP_CHUNK_DIM && mask[v][u + w] == type)
+				++w;
+
+			int h = 1;
+			while (merge_rows && v + h < MAP_CHUNK_DIM) {
+				bool row_matches = true;
+				for (int i = 0; i < w; ++i)
+					row_matches &= mask[v + h][u + i] ==
+						       type;
+				if (!row_matches)
+					break;
+				++h;
+			}
+
+			for (int dv = 0; dv < h; ++dv)
+				memset(&mask[v + dv][u], 0, w);
+			emit(mesh, data, u, v, w, h, type);
+		}
+	}
+}
+
+struct top_faces {
+	int x0, y0; // chunk origin in map cells
+};
+
+// mask is [y][x]
+static void emit_top(struct terrain_mesh *mesh, const void *data, int u,
+		     int v, int w, int h, enum map_type type)
+{
+	const struct top_faces *top = data;
+	float x0 = top->x0 + u - 0.5f, x1 = x0 + w;
+	float y0 = top->y0 + v - 0.5f, y1 = y0 + h;
+	float world_y = type == MTYPE_FLOOR ? FLOOR_TOP : SOLID_TOP;
+
+	vec3 corners[4];
+	map_to_world(x0, y0, world_y, corners[0]);
+	map_to_world(x1, y0, world_y, corners[1]);
+	map_to_world(x1, y1, world_y, corners[2]);
+	map_to_world(x0, y1, world_y, corners[3]);
+	emit_quad(mesh, corners, (vec3){ 0.0f, 1.0f, 0.0f }, type);
+}
+
+struct side_faces {
+	int x0, y0; // chunk origin in map cells
+	int dx, dy; // direction the faces point, in map cells
+};
+
+// mask is [slice][along], slices run across the face direction
+static void emit_side(struct terrain_mesh *mesh, const void *data, int u,
+		      int v, int w, int h, enum map_type type)
+{
+	const struct side_faces *side = data;
+	float bottom = type == MTYPE_FLOOR ? FLOOR_BOTTOM : SOLID_BOTTOM;
+	float top = type == MTYPE_FLOOR ? FLOOR_TOP : SOLID_TOP;
+
+	// the face plane sits half a cell from the slice's cell centers
+	float x0, x1, y0, y1;
+	if (side->dx) {
+		x0 = x1 = side->x0 + v + side->dx * 0.5f;
+		y0 = side->y0 + u - 0.5f;
+		y1 = y0 + w;
+	} else {
+		y0 = y1 = side->y0 + v + side->dy * 0.5f;
+		x0 = side->x0 + u - 0.5f;
+		x1 = x0 + w;
+	}
+
+	vec3 corners[4];
+	map_to_world(x0, y0, bottom, corners[0]);
+	map_to_world(x1, y1, bottom, corners[1]);
+	map_to_world(x1, y1, top, corners[2]);
+	map_to_world(x0, y0, top, corners[3]);
+	// see map_to_world(), map x is world z and map y is world -x
+	vec3 normal = { (float)-side->dy, 0.0f, (float)side->dx };
+	emit_quad(mesh, corners, normal, type);
+}
+
+void terrain_mesh_chunk(const struct map_model *map, int cx, int cy,
+			struct terrain_mesh *mesh)
+{
+	mesh->num_vertices = 0;
+	mesh->num_indices = 0;
+	glm_vec3_copy((vec3){ FLT_MAX, FLT_MAX, FLT_MAX }, mesh->min);
+	glm_vec3_copy((vec3){ -FLT_MAX, -FLT_MAX, -FLT_MAX }, mesh->max);
+
+	int x0 = cx << MAP_CHUNK_SHIFT;
+	int y0 = cy << MAP_CHUNK_SHIFT;
+
+	// cells with a one cell border from the neighbouring chunks, out of
+	// bounds reads as MTYPE_NONE
+	uint8_t cells[MAP_CHUNK_DIM + 2][MAP_CHUNK_DIM + 2];
+	bool any = false;
+	for (int y = -1; y <= MAP_CHUNK_DIM; ++y) {
+		for (int x = -1; x <= MAP_CHUNK_DIM; ++x) {
+			uint8_t type = map_get(map, x0 + x, y0 + y);
+			cells[y + 1][x + 1] = type;
+			if (x >= 0 && x < MAP_CHUNK_DIM && y >= 0 &&
+			    y < MAP_CHUNK_DIM)
+				any |= type != MTYPE_NONE;
+		}
+	}
+	if (!any)
+		return;
+
+	// tops are always open, nothing sits on top of a cell
+	uint8_t mask[MAP_CHUNK_DIM][MAP_CHUNK_DIM];
+	for (int y = 0; y < MAP_CHUNK_DIM; ++y)
+		for (int x = 0; x < MAP_CHUNK_DIM; ++x)
+			mask[y][x] = cells[y + 1][x + 1];
+	greedy_merge(mask, true, emit_top, mesh,
+		     &(struct top_faces){ x0, y0 });
+
+	// solid sides show towards anything not solid. floor sides are below
+	// ground level unless they border the unknown. bottoms never show
+	static const int dirs[4][2] = { { 1, 0 }, { -1, 0 }, { 0, 1 }, { 0, -1 } };
+	for (int d = 0; d < 4; ++d) {
+		int dx = dirs[d][0], dy = dirs[d][1];
+		for (int slice = 0; slice < MAP_CHUNK_DIM; ++slice) {
+			for (int along = 0; along < MAP_CHUNK_DIM; ++along) {
+				int x = dx ? slice : along;
+				int y = dx ? along : slice;
+				enum map_type type = cells[y + 1][x + 1];
+				enum map_type next =
+					cells[y + 1 + dy][x + 1 + dx];
+				bool open = map_type_solid(type) ?
+						    !map_type_solid(next) :
+						    next == MTYPE_NONE;
+				mask[slice][along] =
+					type != MTYPE_NONE && open ? type : 0;
+			}
+		}
+		greedy_merge(mask, false, emit_side, mesh,
+			     &(struct side_faces){ x0, y0, dx, dy });
+	}
+}
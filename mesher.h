@@ -0,0 +1,39 @@
+#ifndef MESHER_H
+#define MESHER_H
+
+#include "map.h"
+
+#include "cglm/include/cglm/cglm.h"
+
+#include <stdint.h>
+
+// static terrain is meshed per map chunk instead of drawing a cube per tile.
+// only faces next to open space are emitted, and neighbouring faces of the
+// same type are merged into larger quads. solid cells fill [-1, 1] in world
+// y, floors the tile below, see map_tile_center()
+
+struct terrain_vertex {
+	vec3 pos;
+	uint32_t type; // enum map_type, indexes the palette
+};
+
+// worst case: every cell shows its top and four sides
+#define TERRAIN_CHUNK_MAX_QUADS (MAP_CHUNK_CELLS * 5)
+#define TERRAIN_CHUNK_MAX_VERTICES (TERRAIN_CHUNK_MAX_QUADS * 4)
+#define TERRAIN_CHUNK_MAX_INDICES (TERRAIN_CHUNK_MAX_QUADS * 6)
+
+struct terrain_mesh {
+	// set by the caller, with room for the worst case
+	struct terrain_vertex *vertices;
+	uint16_t *indices; // relative to the chunk's first vertex
+	int num_vertices, num_indices;
+	vec3 min, max; // world space bounds, only valid if num_indices
+};
+
+// mesh chunk (cx, cy) of the current level. cells in neighbouring chunks are
+// looked at too, so a chunk needs remeshing when a cell on its border changes
+// in the chunk next to it
+void terrain_mesh_chunk(const struct map_model *map, int cx, int cy,
+			struct terrain_mesh *mesh);
+
+#endif
@@ -1,14 +1,24 @@
 #include "net_data.h"
+#include "arena.h"
 #include "game.h"
 #include "log.h"
 #include "cJSON.h"
-#include "game.h"
+#include "json_stream.h"
+#include "net_frame.h"
+#include "spsc.h"
+
+#include <SDL3/SDL.h>
+
 #include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <poll.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h> // abort
 #include <string.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <sys/un.h>
 #include <unistd.h>
 
@@ -17,26 +27,71 @@
 
 char sock_name[SUN_PATH_MAX];
 
-static int sock_fd;
+static int sock_fd = -1;
+
+// usual receive buffer size, grows only while an oversized frame is pending
+#define RECV_BUF_LEN (64 * 1024)
+
+// only touched by the network thread
+static struct frame_buf recv_buf;
 
-#define MSG_INIT_LEN 2048
+// every cJSON node and string of one message, released together once the
+// message is handled. only the network thread uses cJSON
+#define JSON_ARENA_LEN (64 * 1024)
+#define JSON_ARENA_MAX_LEN (4 * 1024 * 1024)
+static struct arena json_arena;
 
-char *cur_msg;
-static size_t cur_msg_max_size; // buffer size, largest message received so far
+// ring lengths, powers of two
+#define NET_OUTGOING_LEN TURN_QUEUE_LEN
+#define NET_INCOMING_LEN 16
 
-int msg_idx;
+// a turn with the sequence number its response is matched by
+struct net_turn {
+	struct turn turn;
+	uint32_t seq;
+};
 
-struct pollfd fds[1];
+// most turns sent by one writev
+#define NET_SEND_BATCH 16
+
+static struct spsc_ring outgoing; // struct net_turn, game loop -> network thread
+static struct spsc_ring incoming; // struct net_update, network thread -> game loop
+
+static SDL_Thread *net_thread;
+static atomic_bool net_quit;
+// the game loop writes a byte here to wake the network thread out of poll
+static int wake_fds[2] = { -1, -1 };
+// set while the network thread is (about to be) blocked in poll. submits
+// only write the wake pipe then, so a busy network thread costs them no
+// syscall
+static atomic_bool net_sleeping;
+// signalled per committed update, lets turn_flush() sleep instead of spin
+static SDL_Semaphore *update_sem;
+
+enum { POLL_SOCK, POLL_WAKE, POLL_COUNT };
+static struct pollfd fds[POLL_COUNT];
 
 // for each mf we see
 // supposedly 26 = unexplored is the last
 #define MF_MAX 26
-static enum map_type mf_to_map_type[MF_MAX+1];
+static uint8_t mf_to_map_type[MF_MAX+1];
+
+static int net_thread_main(void *data);
+
+static void *json_arena_malloc(size_t size)
+{
+	return arena_alloc(&json_arena, size);
+}
+
+// freed all at once by arena_reset()
+static void json_arena_free(void *ptr)
+{
+}
 
 bool net_data_init(void)
 {
 	// already set up
-	if (sock_fd)
+	if (net_thread)
 		return true;
 
 	// set map network type to internal type correspondence
@@ -47,14 +102,13 @@ bool net_data_init(void)
 	mf_to_map_type[2] = MTYPE_WALL;
 	mf_to_map_type[26] = MTYPE_UNEXPLORED;
 
-	cur_msg = malloc(MSG_INIT_LEN);
-	if (!cur_msg) {
+	if (!frame_buf_init(&recv_buf, RECV_BUF_LEN) ||
+	    !arena_init(&json_arena, JSON_ARENA_LEN, JSON_ARENA_MAX_LEN)) {
 		fputs("failed to call malloc", stderr);
 		return false;
 	}
-
-	// dummy init msg string
-	strcpy(cur_msg, "waiting for message...");
+	cJSON_InitHooks(&(cJSON_Hooks){ .malloc_fn = json_arena_malloc,
+					 .free_fn = json_arena_free });
 
 	if ((sock_fd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1) {
 		perror("socket creation failed");
@@ -77,119 +131,383 @@ bool net_data_init(void)
 		return false;
 	}
 
-	fds[0] = (struct pollfd){ .fd = sock_fd, .events = POLLIN };
+	if (pipe(wake_fds) == -1) {
+		perror("wake pipe creation failed");
+		return false;
+	}
+	// never block either side on a full/empty pipe, one pending byte is enough
+	fcntl(wake_fds[0], F_SETFL, fcntl(wake_fds[0], F_GETFL) | O_NONBLOCK);
+	fcntl(wake_fds[1], F_SETFL, fcntl(wake_fds[1], F_GETFL) | O_NONBLOCK);
+
+	fds[POLL_SOCK] = (struct pollfd){ .fd = sock_fd, .events = POLLIN };
+	fds[POLL_WAKE] = (struct pollfd){ .fd = wake_fds[0], .events = POLLIN };
+
+	if (!spsc_init(&outgoing, sizeof(struct net_turn), NET_OUTGOING_LEN) ||
+	    !spsc_init(&incoming, sizeof(struct net_update),
+		       NET_INCOMING_LEN)) {
+		log_err("failed to allocate network rings");
+		return false;
+	}
+
+	update_sem = SDL_CreateSemaphore(0);
+	if (!update_sem) {
+		log_err("SDL_CreateSemaphore failed: %s", SDL_GetError());
+		return false;
+	}
+
+	atomic_store(&net_quit, false);
+	net_thread = SDL_CreateThread(net_thread_main, "net_data", NULL);
+	if (!net_thread) {
+		log_err("SDL_CreateThread failed: %s", SDL_GetError());
+		return false;
+	}
 
 	return true;
 }
 
+static void wake_net_thread(void)
+{
+	// EAGAIN just means a wakeup is already pending
+	char c = 0;
+	if (write(wake_fds[1], &c, 1) == -1 && errno != EAGAIN)
+		perror("wake write failed");
+}
+
 bool net_data_exit(void)
 {
-	close(sock_fd);
-	unlink(sock_name);
+	if (net_thread) {
+		atomic_store(&net_quit, true);
+		wake_net_thread();
+		SDL_WaitThread(net_thread, NULL);
+		net_thread = NULL;
+	}
+	// net_data_init() may have failed part way
+	for (int i = 0; i < 2; ++i) {
+		if (wake_fds[i] != -1)
+			close(wake_fds[i]);
+		wake_fds[i] = -1;
+	}
+	if (sock_fd != -1) {
+		close(sock_fd);
+		sock_fd = -1;
+		unlink(sock_name);
+	}
+
+	spsc_free(&outgoing);
+	spsc_free(&incoming);
+	SDL_DestroySemaphore(update_sem);
+	update_sem = NULL;
+	frame_buf_free(&recv_buf);
+	cJSON_InitHooks(NULL);
+	arena_free(&json_arena);
 	return true;
 }
 
-const char *turn_to_message(const struct turn *turn)
+size_t turn_to_message(const struct turn *turn, uint32_t seq, char *buf,
+		       size_t len)
 {
-	return "this is a test turn message";
+	int n = snprintf(buf, len, "{\"msg\":\"turn\",\"seq\":%u,\"move\":%d}",
+			 seq, turn->value.move);
+	assert(n > 0 && (size_t)n < len);
+	return (size_t)n;
 }
 
-bool send_turn_message(const char *message)
+bool net_data_submit(const struct turn *turn, uint32_t seq)
 {
-	size_t msgsz = (size_t)strlen(message);
-	// don't include \0 here, client will have to pad own received string
-	if (send(sock_fd, &msgsz, sizeof(msgsz), 0) != sizeof(msgsz)) {
-		perror("send failed");
+	struct net_turn *queued = spsc_reserve(&outgoing);
+	if (!queued)
 		return false;
-	}
+	*queued = (struct net_turn){ .turn = *turn, .seq = seq };
+	spsc_commit(&outgoing);
+	// pairs with the fence in net_thread_main(): either it sees this turn
+	// before sleeping or this sees it sleeping
+	atomic_thread_fence(memory_order_seq_cst);
+	if (atomic_load(&net_sleeping))
+		wake_net_thread();
+	return true;
+}
+
+const struct net_update *net_data_peek_update(void)
+{
+	return spsc_peek(&incoming);
+}
+
+void net_data_release_update(void)
+{
+	spsc_release(&incoming);
+}
+
+void net_data_wait_update(int timeout_ms)
+{
+	SDL_WaitSemaphoreTimeout(update_sem, timeout_ms);
+}
+
+// network thread from here on
 
-	// don't include the \0 in send? since we're sending raw json, not a string"
-	int tot_sent = 0;
-	int this_send = 0;
-	while (tot_sent < msgsz) {
-		if ((this_send = send(sock_fd, message + tot_sent,
-				      msgsz - tot_sent, 0)) < 1) {
+// last turn handed to the socket, or failed for lack of one
+static uint32_t sent_seq;
+// last turn a response has answered
+static uint32_t acked_seq;
+
+// serial number order, correct across wraparound
+static bool seq_after(uint32_t a, uint32_t b)
+{
+	return (int32_t)(a - b) > 0;
+}
+
+// write every iovec out, continuing after partial writes
+static bool write_frames(struct iovec *iov, int iovcnt)
+{
+	while (iovcnt > 0) {
+		ssize_t n = writev(sock_fd, iov, iovcnt);
+		if (n < 1) {
+			if (n < 0 && errno == EINTR)
+				continue;
 			// 0 for disconnect is also fatal
-			perror("send failed");
+			perror("writev failed");
 			return false;
 		}
-		tot_sent += this_send;
+		for (; iovcnt > 0 && (size_t)n >= iov->iov_len; ++iov, --iovcnt)
+			n -= iov->iov_len;
+		if (iovcnt > 0) {
+			iov->iov_base = (char *)iov->iov_base + n;
+			iov->iov_len -= n;
+		}
 	}
 	return true;
 }
 
-const char *get_turn_response(void)
+// frame up to NET_SEND_BATCH queued turns, each as its {size_t len, message},
+// and write them with one syscall. returns the number of turns taken off the
+// ring. while disconnected they are only marked sent, fail_outstanding()
+// then fails them in order
+static int send_turn_batch(bool *connected)
 {
-	// for fixed header-sized messages, define this to be our message interface: {size_t len, message}
+	static char messages[NET_SEND_BATCH][TURN_MESSAGE_MAX];
+	// don't include \0, the server pads its own received string
+	static size_t lens[NET_SEND_BATCH];
+	struct iovec iov[2 * NET_SEND_BATCH];
+
+	int count = 0;
+	const struct net_turn *queued;
+	while (count < NET_SEND_BATCH && (queued = spsc_peek(&outgoing))) {
+		lens[count] = turn_to_message(&queued->turn, queued->seq,
+					      messages[count],
+					      sizeof(messages[count]));
+		iov[2 * count] = (struct iovec){ .iov_base = &lens[count],
+						 .iov_len = sizeof(lens[count]) };
+		iov[2 * count + 1] = (struct iovec){ .iov_base = messages[count],
+						     .iov_len = lens[count] };
+		sent_seq = queued->seq;
+		++count;
+		spsc_release(&outgoing);
+	}
 
-	// wait until readable POLLIN
-	if (poll(fds, 1, -1) < 1) {
-		fprintf(stderr, "poll error or not ready\n");
-		return NULL;
+	if (count && *connected) {
+		log_trace("sending %d turns up to seq %u", count, sent_seq);
+		if (!write_frames(iov, 2 * count))
+			*connected = false;
 	}
-	if (fds[0].revents & POLLHUP) {
-		fprintf(stderr, "poll hangup\n");
-		return NULL;
+	return count;
+}
+
+// next free incoming slot, waits for the game loop to drain the ring if full.
+// NULL only when shutting down
+static struct net_update *reserve_update(void)
+{
+	struct net_update *update;
+	while (!(update = spsc_reserve(&incoming))) {
+		if (atomic_load(&net_quit))
+			return NULL;
+		SDL_Delay(1);
 	}
+	return update;
+}
+
+static void commit_update(void)
+{
+	spsc_commit(&incoming);
+	SDL_SignalSemaphore(update_sem);
+}
 
-	// read size header, set up appropriately sized message buffer
-	size_t len;
-	if (recv(sock_fd, &len, sizeof(len), 0) != sizeof(len)) {
-		perror("recv header len failed");
-		return NULL;
+// header only, cells are filled in as they are parsed
+static void begin_update(struct net_update *update, int first_cell, bool first)
+{
+	update->first_cell = first_cell;
+	update->level = -1;
+	update->cells.count = 0;
+	update->first = first;
+	update->clear = false;
+	update->last = false;
+	update->answers_turn = false;
+	update->success = true;
+	update->seq = 0;
+}
+
+// fail every turn still awaiting a response, without any map data
+static void fail_outstanding(void)
+{
+	if (acked_seq == sent_seq)
+		return;
+	struct net_update *update = reserve_update();
+	if (!update)
+		return;
+	begin_update(update, 0, true);
+	update->last = true;
+	update->answers_turn = true;
+	update->success = false;
+	update->seq = sent_seq;
+	acked_seq = sent_seq;
+	commit_update();
+}
+
+// a response with a seq answers every turn up to that seq, e.g. a server that
+// replies once to a burst of moves. one without answers the oldest turn still
+// awaiting a response. false for unprompted messages
+static bool ack_response(bool has_seq, uint32_t seq)
+{
+	if (!has_seq)
+		seq = acked_seq + 1;
+	if (!seq_after(seq, acked_seq) || seq_after(seq, sent_seq)) {
+		if (has_seq)
+			log_warn("response seq %u outside awaited %u..%u", seq,
+				 acked_seq + 1, sent_seq);
+		return false;
 	}
-	fprintf(stderr, "received len: %zu\n", len);
+	acked_seq = seq;
+	return true;
+}
 
-	// >= since we need to add an additional '\0'
-	if (len >= cur_msg_max_size) {
-		if ((cur_msg = realloc(cur_msg, len + 1)) == NULL) {
-			fputs("failed to realloc message buffer", stderr);
-			return NULL;
+static bool process_turn_response(const char *response, size_t len);
+
+static int net_thread_main(void *data)
+{
+	bool connected = true;
+
+	while (!atomic_load(&net_quit)) {
+		while (send_turn_batch(&connected))
+			;
+		if (!connected)
+			fail_outstanding();
+
+		// announce sleeping before the last look at the ring, a turn
+		// submitted after that look writes the wake pipe
+		atomic_store(&net_sleeping, true);
+		atomic_thread_fence(memory_order_seq_cst);
+		if (spsc_peek(&outgoing)) {
+			atomic_store(&net_sleeping, false);
+			continue;
+		}
+		int polled = poll(fds, POLL_COUNT, -1);
+		atomic_store(&net_sleeping, false);
+		if (polled < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("poll error");
+			break;
 		}
-		cur_msg_max_size = len + 1;
-	}
 
-	size_t bytes_read = 0;
-	size_t bytes_remaining = len;
-	while (bytes_remaining > 0) {
-		if ((len = recv(sock_fd, cur_msg + bytes_read, bytes_remaining,
-				0)) == -1) {
-			perror("recv failed");
-			return NULL;
+		if (fds[POLL_WAKE].revents & POLLIN) {
+			char drain[64];
+			while (read(wake_fds[0], drain, sizeof(drain)) > 0)
+				;
 		}
-		bytes_read += len;
-		bytes_remaining -= len;
-	}
-	cur_msg[bytes_read] = '\0';
-	// log_trace("cur_msg: %s", cur_msg);
 
-	msg_idx++;
+		short sock_events = fds[POLL_SOCK].revents;
+		if (sock_events & POLLIN) {
+			// one recv may carry several frames, or only part of one
+			ssize_t n = frame_buf_fill(&recv_buf, sock_fd);
+			if (n == 0) {
+				fprintf(stderr, "server closed connection\n");
+				connected = false;
+			} else if (n < 0 && errno != EAGAIN &&
+				   errno != EWOULDBLOCK) {
+				perror("recv failed");
+				connected = false;
+			}
+
+			struct frame_view frame;
+			while (frame_buf_next(&recv_buf, &frame)) {
+				log_trace("received len: %zu", frame.len);
+				process_turn_response(frame.data, frame.len);
+			}
+			if (frame_buf_error(&recv_buf)) {
+				log_err("invalid message length header");
+				connected = false;
+			}
+		} else if (sock_events & (POLLHUP | POLLERR)) {
+			fprintf(stderr, "poll hangup\n");
+			connected = false;
+		}
 
-	// TODO make a new buffer each time?
-	return cur_msg;
+		if (!connected && fds[POLL_SOCK].fd != -1) {
+			log_err("lost connection to server");
+			// poll ignores negative fds
+			fds[POLL_SOCK].fd = -1;
+			fail_outstanding();
+		}
+	}
+
+	return 0;
 }
 
-bool process_turn_response(const char *response, struct game_context *ctx)
+// generic path for messages without map cells, builds a full cJSON tree.
+// the tree lives in json_arena, so there is no cJSON_Delete walk
+static bool process_json_message(const char *response, size_t len)
 {
-	bool ret = true;
+	bool ret = false;
 
-	cJSON *response_json = cJSON_Parse(response);
+	cJSON *response_json = cJSON_ParseWithLength(response, len);
+	if (!response_json) {
+		log_err("failed to parse response json");
+		goto exit;
+	}
 
-	char *response_print = cJSON_Print(response_json);
-	log_trace("response json: %s", response_print);
+	// log_trace only evaluates this at trace level, printed into json_arena
+	log_trace("response json: %s", cJSON_Print(response_json));
 
-	// for now expect msg: map, cells: array of object with xys
-	const cJSON *cells =
-		cJSON_GetObjectItemCaseSensitive(response_json, "cells");
-	if (!cells) {
-		ret = false;
-		goto exit;
+	const cJSON *msg = cJSON_GetObjectItemCaseSensitive(response_json, "msg");
+	// TODO: handle other message types, for now a turn needs map cells
+	log_info("unhandled message type: %s",
+		 cJSON_IsString(msg) ? msg->valuestring : "(none)");
+
+exit:
+	arena_reset(&json_arena);
+	return ret;
+}
+
+// append a parsed cell, handing the update over to the game loop once full.
+// false only when shutting down
+static bool emit_cell(struct net_update **update, int cell_idx, int x, int y,
+		      uint8_t type)
+{
+	struct map_cells *cells = &(*update)->cells;
+	if (cells->count == MAP_BATCH_CELLS) {
+		commit_update();
+		if (!(*update = reserve_update()))
+			return false;
+		begin_update(*update, cell_idx, false);
+		cells = &(*update)->cells;
 	}
+	cells->x[cells->count] = (int16_t)x;
+	cells->y[cells->count] = (int16_t)y;
+	cells->type[cells->count] = type;
+	++cells->count;
+	return true;
+}
 
-	// first reset ctx->visible_map
-	memset(ctx->visible_map, 0,
-	       MAX_MAP_VISIBLE * sizeof(struct map_pos_info));
+static bool read_cell_int(struct json_cursor *c, const char *name, int *out)
+{
+	if (json_read_int(c, out))
+		return true;
+	log_err("cell_elem %s json element is not an integer near: %.*s", name,
+		(int)(c->end - c->p < 32 ? c->end - c->p : 32), c->p);
+	return false;
+}
 
+// decode the cells array straight into the update as it is scanned
+static bool decode_cells(struct json_cursor *c, struct net_update **update)
+{
 	/*
 	 * retain x and y unless updated
 	 * start at xmin, ymin, each elem implicitly increments x
@@ -197,62 +515,184 @@ bool process_turn_response(const char *response, struct game_context *ctx)
 	 * series of “empty cells” in a row (cells not sent), will 
 	 * contain the x and y value"
 	*/
-	cJSON *cell;
 	int cell_idx = 0;
-	struct map_pos_info tile_info = {};
-	cJSON_ArrayForEach(cell, cells)
-	{
+	int x = 0, y = 0;
+	uint8_t type;
+	if (!json_array_begin(c))
+		return false;
+	while (json_array_next(c)) {
 		// reset tile info
-		tile_info.type = MTYPE_UNKNOWN;
+		type = MTYPE_UNKNOWN;
 		bool has_x = false;
+		bool valid = true;
 
-		cJSON *cell_elem;
-		cJSON_ArrayForEach(cell_elem, cell)
-		{
-
-			if (strcmp(cell_elem->string, "x") == 0) {
-				if (!cJSON_IsNumber(cell_elem)) {
-					log_err("cell_elem x json element is not a number: %f, %s, %s",
-						cell_elem->valuedouble,
-						cell_elem->string,
-						cell_elem->valuestring);
-					ret = false;
-					goto exit;
-				}
-				tile_info.coord.x = cell_elem->valueint;
+		struct json_str key;
+		int val;
+		if (!json_object_begin(c))
+			return false;
+		while (json_object_next(c, &key)) {
+			if (json_str_eq(key, "x")) {
+				if (!read_cell_int(c, "x", &x))
+					return false;
 				has_x = true;
-			} else if (strcmp(cell_elem->string, "y") == 0) {
-				if (!cJSON_IsNumber(cell_elem)) {
-					log_err("cell_elem y json element is not a number: %f",
-						cell_elem->valuedouble);
-					ret = false;
-					goto exit;
-				}
-				tile_info.coord.y = cell_elem->valueint;
-			} else if (strcmp(cell_elem->string, "mf") == 0) {
-				if (!cJSON_IsNumber(cell_elem)) {
-					log_err("cell_elem mf json element is not a number: %f",
-						cell_elem->valuedouble);
-					ret = false;
-					goto exit;
+			} else if (json_str_eq(key, "y")) {
+				if (!read_cell_int(c, "y", &y))
+					return false;
+			} else if (json_str_eq(key, "mf")) {
+				if (!read_cell_int(c, "mf", &val))
+					return false;
+				if (val >= 0 && val <= MF_MAX) {
+					type = mf_to_map_type[val];
+				} else {
+					log_warn("skipping cell with mf %d",
+						 val);
+					valid = false;
 				}
-				assert(cell_elem->valueint <= MF_MAX);
-				tile_info.type = mf_to_map_type[cell_elem->valueint];
+			} else if (!json_skip(c)) {
+				// TODO: add remaining cells info
+				return false;
 			}
-			// TODO: add remaining cells info
-
-
 		}
+		if (c->error)
+			return false;
 		if (!has_x)
-			++tile_info.coord.x;
+			++x;
+		// it still took up its x
+		if (!valid)
+			continue;
 
-		ctx->visible_map[cell_idx] = tile_info;
+		if (!emit_cell(update, cell_idx, x, y, type))
+			return false;
 		++cell_idx;
 	}
+	return !c->error;
+}
+
+// map level id for a dcss branch and depth, e.g. "Dungeon" 3
+static int level_id(struct json_str place, int depth)
+{
+	// fnv-1a over the branch name, then the depth
+	uint32_t hash = 2166136261u;
+	for (size_t i = 0; i < place.len; ++i) {
+		hash ^= (uint8_t)place.s[i];
+		hash *= 16777619u;
+	}
+	hash ^= (uint32_t)depth;
+	hash *= 16777619u;
+	return (int)(hash & INT32_MAX);
+}
+
+// the level has to switch before any of the response's cells are applied
+static void set_update_level(struct net_update *update, bool has_depth,
+			     struct json_str place, int depth)
+{
+	if (!has_depth)
+		return;
+	if (update->first && update->cells.count == 0)
+		update->level = level_id(place, depth);
+	else
+		log_warn("ignoring depth after the cells of a response");
+}
+
+static bool process_turn_response(const char *response, size_t len)
+{
+	bool ret = true;
+	bool has_seq = false;
+	int seq = 0;
+	bool has_depth = false;
+	int depth = 0;
+	struct json_str place = { "", 0 };
+
+	struct net_update *update = reserve_update();
+	if (!update)
+		return false;
+	begin_update(update, 0, true);
+
+	log_trace("response json: %.*s", (int)len, response);
+
+	// for now expect msg: map, cells: array of object with xys.
+	// scan the top level object once, decoding cells in place
+	struct json_cursor c;
+	json_init(&c, response, len);
+	bool has_cells = false;
+	struct json_str key;
+	if (!json_object_begin(&c)) {
+		ret = false;
+		goto exit;
+	}
+	while (json_object_next(&c, &key)) {
+		if (json_str_eq(key, "clear")) {
+			// only meaningful ahead of the cells it applies to
+			if (json_peek(&c) == 't' && update->first &&
+			    update->cells.count == 0)
+				update->clear = true;
+			if (!json_skip(&c))
+				break;
+		} else if (json_str_eq(key, "seq")) {
+			if (!json_read_int(&c, &seq))
+				break;
+			has_seq = true;
+		} else if (json_str_eq(key, "place")) {
+			if (!json_read_string(&c, &place))
+				break;
+		} else if (json_str_eq(key, "depth")) {
+			if (!json_read_int(&c, &depth))
+				break;
+			has_depth = true;
+		} else if (json_str_eq(key, "cells")) {
+			has_cells = true;
+			set_update_level(update, has_depth, place, depth);
+			has_depth = false;
+			if (!decode_cells(&c, &update) &&
+			    !c.error) {
+				// shutting down
+				ret = false;
+				goto exit;
+			}
+		} else if (!json_skip(&c)) {
+			break;
+		}
+	}
+	if (c.error) {
+		log_err("malformed response json at offset %zu",
+			(size_t)(c.p - response));
+		ret = false;
+		goto exit;
+	}
+
+	// e.g. a player message with only the level
+	set_update_level(update, has_depth, place, depth);
+	if (!has_cells)
+		ret = process_json_message(response, len);
 
-	// not printing here...
-	print_map_pos_info(ctx->visible_map, cell_idx);
 exit:
-	cJSON_Delete(response_json);
+	if (update) {
+		// still apply unprompted server messages, they just don't
+		// complete a turn
+		// cells handed over before an error stay applied, see
+		// struct net_update
+		update->last = true;
+		update->answers_turn = ack_response(has_seq, (uint32_t)seq);
+		update->success = ret;
+		update->seq = acked_seq;
+		commit_update();
+	}
 	return ret;
 }
+
+void apply_net_update(const struct net_update *update,
+		      struct game_context *ctx)
+{
+	// what was seen of the old level is kept for when the player returns
+	if (update->level >= 0)
+		map_set_level(&ctx->map, update->level);
+	// the server only sends cells that changed, the rest stay as they were
+	if (update->clear)
+		map_clear(&ctx->map);
+
+	const struct map_cells *cells = &update->cells;
+	for (int i = 0; i < cells->count; ++i)
+		map_set(&ctx->map, cells->x[i], cells->y[i], cells->type[i]);
+
+	print_map_cells(cells);
+}
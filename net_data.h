@@ -1,28 +1,70 @@
 #ifndef NET_DATA_H
 #define NET_DATA_H
 
+#include "game.h"
 #include "turn.h"
 
 #include <stdbool.h>
 
-extern char *cur_msg;
-extern int msg_idx;
+// all socket work happens on a dedicated network thread. the game loop hands it
+// turns and drains parsed updates through lock-free spsc rings, so it never
+// makes a socket syscall itself
 
+// parsed server response, or part of one. larger responses are split over
+// consecutive updates of up to MAP_BATCH_CELLS cells
+//
+// updates are handed over as they fill, before the rest of the response is
+// parsed. if the response then turns out malformed, the cells already handed
+// over stay applied and the last update reports !success. those cells are
+// each a complete delta the server sent, so the map is left partly updated
+// but never wrong. after a clear it is missing whatever the response didn't
+// get to, until the server sends those cells again
+struct net_update {
+	struct map_cells cells;
+	int first_cell; // index of the first cell within the whole response
+	// only set on the first update of a response: level the cells belong
+	// to, from the response's "place" and "depth". -1 if it doesn't say
+	int level;
+	bool first; // first update of a response
+	bool clear; // forget the whole map before applying the cells
+	bool last; // final update of a response
+	// only set on the last update of a response:
+	bool answers_turn; // false for messages the server sent unprompted
+	bool success; // false if the turn failed to send or its response to parse
+	uint32_t seq; // every turn submitted up to this seq is answered
+};
+
+// connects and starts the network thread
 bool net_data_init(void);
+// stops the network thread and closes the socket
 bool net_data_exit(void);
 
-const char *turn_to_message(const struct turn *turn);
+// longest serialized turn
+#define TURN_MESSAGE_MAX 128
+
+// serialize turn into buf, returns its length
+size_t turn_to_message(const struct turn *turn, uint32_t seq, char *buf,
+		       size_t len);
+
+// queue a turn for the network thread to send, returns false if the outgoing
+// ring is full. seq must be one more than the previous turn's.
+// everything queued by the time the network thread wakes goes out in one
+// writev. the server answers in order, either one response per turn or one
+// response carrying the seq of the last turn it answers
+bool net_data_submit(const struct turn *turn, uint32_t seq);
 
-// call this in void do_turn(turn); which sends message, parses response, and updates game state accordingly
-// (separate from a dcss turn since a move may be less than 1 turn of game time)
-bool send_turn_message(const char *message);
+// oldest update received from the network thread, NULL if none are waiting.
+// the update stays valid until net_data_release_update()
+const struct net_update *net_data_peek_update(void);
+void net_data_release_update(void);
 
-// call once per call of send_turn_message
-const char *get_turn_response(void);
+// block until an update may be available or timeout_ms passes,
+// only for use outside the frame loop
+void net_data_wait_update(int timeout_ms);
 
 struct game_context;
-// e.g. read json into struct map_pos_info[] format
-// TODO: how to split between turn.c?
-bool process_turn_response(const char *response, struct game_context *ctx);
+// apply parsed cells to the map model as deltas
+void apply_net_update(const struct net_update *update,
+		      struct game_context *ctx);
 
 #endif
@@ -0,0 +1,113 @@
+#include "net_frame.h"
+#include "log.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#define FRAME_HEADER_LEN sizeof(size_t)
+
+bool frame_buf_init(struct frame_buf *fb, size_t cap)
+{
+	*fb = (struct frame_buf){ 0 };
+	fb->data = malloc(cap);
+	if (!fb->data)
+		return false;
+	fb->cap = cap;
+	fb->base_cap = cap;
+	return true;
+}
+
+void frame_buf_free(struct frame_buf *fb)
+{
+	free(fb->data);
+	*fb = (struct frame_buf){ 0 };
+}
+
+static size_t buffered(const struct frame_buf *fb)
+{
+	return fb->end - fb->start;
+}
+
+// length of the frame at fb->start, 0 if its header isn't complete yet
+static size_t pending_frame_len(const struct frame_buf *fb)
+{
+	if (buffered(fb) < FRAME_HEADER_LEN)
+		return 0;
+	size_t len;
+	// header may be unaligned
+	memcpy(&len, fb->data + fb->start, FRAME_HEADER_LEN);
+	return len;
+}
+
+bool frame_buf_error(const struct frame_buf *fb)
+{
+	return pending_frame_len(fb) > NET_FRAME_MAX;
+}
+
+// make room to receive the rest of the pending frame. the partial frame is
+// only moved to the front when it wouldn't fit in place, and the buffer only
+// grows for a frame bigger than it
+static bool make_room(struct frame_buf *fb)
+{
+	size_t frame_len = pending_frame_len(fb);
+	if (frame_len > NET_FRAME_MAX)
+		return false;
+	size_t needed = FRAME_HEADER_LEN + frame_len;
+
+	if (fb->start == fb->end) {
+		fb->start = fb->end = 0;
+		// done with any oversized frame, return to the usual footprint
+		if (fb->cap > fb->base_cap) {
+			char *data = realloc(fb->data, fb->base_cap);
+			if (data) {
+				fb->data = data;
+				fb->cap = fb->base_cap;
+			}
+		}
+	} else if (fb->start + needed > fb->cap || fb->end == fb->cap) {
+		memmove(fb->data, fb->data + fb->start, buffered(fb));
+		fb->end -= fb->start;
+		fb->start = 0;
+	}
+
+	if (needed > fb->cap) {
+		char *data = realloc(fb->data, needed);
+		if (!data) {
+			log_err("failed to grow receive buffer to %zu", needed);
+			return false;
+		}
+		fb->data = data;
+		fb->cap = needed;
+	}
+	return true;
+}
+
+ssize_t frame_buf_fill(struct frame_buf *fb, int fd)
+{
+	if (!make_room(fb)) {
+		errno = EMSGSIZE;
+		return -1;
+	}
+	ssize_t n = recv(fd, fb->data + fb->end, fb->cap - fb->end,
+			 MSG_DONTWAIT);
+	if (n > 0)
+		fb->end += n;
+	return n;
+}
+
+bool frame_buf_next(struct frame_buf *fb, struct frame_view *view)
+{
+	if (buffered(fb) < FRAME_HEADER_LEN)
+		return false;
+	size_t len = pending_frame_len(fb);
+	if (len > NET_FRAME_MAX || buffered(fb) - FRAME_HEADER_LEN < len)
+		return false;
+
+	view->data = fb->data + fb->start + FRAME_HEADER_LEN;
+	view->len = len;
+	fb->start += FRAME_HEADER_LEN + len;
+	return true;
+}
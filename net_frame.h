@@ -0,0 +1,47 @@
+#ifndef NET_FRAME_H
+#define NET_FRAME_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+// non-blocking receive side of the {size_t len, message} wire format.
+// bytes are recv'd into one reusable buffer and complete frames are handed
+// out as views into it, so several frames arriving in one recv cost one
+// syscall and no copies
+
+struct frame_buf {
+	char *data;
+	size_t cap;
+	// capacity to shrink back to once an oversized frame has been consumed
+	size_t base_cap;
+	size_t start; // first byte not yet handed out
+	size_t end; // one past the last received byte
+};
+
+// a complete frame body, points into the frame_buf. only valid until the next
+// frame_buf_fill()
+struct frame_view {
+	const char *data;
+	size_t len;
+};
+
+bool frame_buf_init(struct frame_buf *fb, size_t cap);
+void frame_buf_free(struct frame_buf *fb);
+
+// recv whatever is available on fd without blocking. invalidates views.
+// returns bytes read, 0 if the peer closed the connection, -1 on error
+// (errno EAGAIN/EWOULDBLOCK if nothing was available)
+ssize_t frame_buf_fill(struct frame_buf *fb, int fd);
+
+// next complete frame, false if none is fully buffered yet or the header is
+// invalid (see frame_buf_error)
+bool frame_buf_next(struct frame_buf *fb, struct frame_view *view);
+
+// the buffered header announces a frame larger than NET_FRAME_MAX
+bool frame_buf_error(const struct frame_buf *fb);
+
+// reject anything bigger than this as a corrupt header
+#define NET_FRAME_MAX ((size_t)64 << 20)
+
+#endif
@@ -0,0 +1,361 @@
+#include "obj.h"
+#include "log.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// cache layout: header, vertex_count vec3s, index_count 16 bit indices
+#define OBJ_CACHE_MAGIC 0x3148534du // "MSH1"
+#define OBJ_CACHE_VERSION 1
+
+struct obj_cache_header {
+	uint32_t magic;
+	uint32_t version;
+	struct obj_stamp stamp;
+	uint32_t vertex_count;
+	uint32_t index_count;
+};
+_Static_assert(sizeof(struct obj_cache_header) % sizeof(float) == 0,
+	       "cached vertices must stay aligned");
+
+// faces with more corners are rejected
+#define OBJ_MAX_FACE_CORNERS 64
+
+static bool is_space(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
+static bool is_digit(char c)
+{
+	return c >= '0' && c <= '9';
+}
+
+// the text isn't NUL terminated, reading past the end gives NUL instead
+static char at(const char *s, const char *end)
+{
+	return s < end ? *s : '\0';
+}
+
+static const char *skip_spaces(const char *s, const char *end)
+{
+	while (is_space(at(s, end)))
+		++s;
+	return s;
+}
+
+static const double pow10_table[] = { 1e0,  1e1,  1e2,  1e3,  1e4,  1e5,
+				      1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+				      1e12, 1e13, 1e14, 1e15, 1e16, 1e17,
+				      1e18, 1e19, 1e20, 1e21, 1e22 };
+
+static double scale_pow10(double v, int exp)
+{
+	const int max = sizeof(pow10_table) / sizeof(pow10_table[0]) - 1;
+	while (exp > max) {
+		v *= pow10_table[max];
+		exp -= max;
+	}
+	while (exp < -max) {
+		v /= pow10_table[max];
+		exp += max;
+	}
+	return exp >= 0 ? v * pow10_table[exp] : v / pow10_table[-exp];
+}
+
+// [+-]digits[.digits][(e|E)[+-]digits], obj files don't use the other forms
+// strtof accepts. returns the end of the number or NULL if there is none
+static const char *parse_float(const char *s, const char *end, float *out)
+{
+	bool neg = at(s, end) == '-';
+	if (at(s, end) == '-' || at(s, end) == '+')
+		++s;
+
+	// digits past what a double holds only shift the exponent
+	double mantissa = 0.0;
+	int exp = 0;
+	int digits = 0;
+	for (; is_digit(at(s, end)); ++s, ++digits) {
+		if (digits < 18)
+			mantissa = mantissa * 10.0 + (*s - '0');
+		else
+			++exp;
+	}
+	if (at(s, end) == '.') {
+		for (++s; is_digit(at(s, end)); ++s, ++digits) {
+			if (digits < 18) {
+				mantissa = mantissa * 10.0 + (*s - '0');
+				--exp;
+			}
+		}
+	}
+	if (!digits)
+		return NULL;
+
+	if (at(s, end) == 'e' || at(s, end) == 'E') {
+		const char *e = s + 1;
+		bool exp_neg = at(e, end) == '-';
+		if (at(e, end) == '-' || at(e, end) == '+')
+			++e;
+		if (is_digit(at(e, end))) {
+			int e_val = 0;
+			for (; is_digit(at(e, end)); ++e)
+				if (e_val < 10000)
+					e_val = e_val * 10 + (*e - '0');
+			exp += exp_neg ? -e_val : e_val;
+			s = e;
+		}
+	}
+
+	double v = exp ? scale_pow10(mantissa, exp) : mantissa;
+	*out = (float)(neg ? -v : v);
+	return s;
+}
+
+static const char *parse_int(const char *s, const char *end, long *out)
+{
+	bool neg = at(s, end) == '-';
+	if (at(s, end) == '-' || at(s, end) == '+')
+		++s;
+	if (!is_digit(at(s, end)))
+		return NULL;
+	long v = 0;
+	for (; is_digit(at(s, end)); ++s)
+		if (v < 1000000000L)
+			v = v * 10 + (*s - '0');
+	*out = neg ? -v : v;
+	return s;
+}
+
+// grow *array to hold at least count elements
+static bool reserve(void **array, uint32_t *cap, uint32_t count, size_t size)
+{
+	if (count <= *cap)
+		return true;
+	uint32_t new_cap = *cap ? *cap * 2 : 256;
+	while (new_cap < count)
+		new_cap *= 2;
+	void *grown = realloc(*array, new_cap * size);
+	if (!grown)
+		return false;
+	*array = grown;
+	*cap = new_cap;
+	return true;
+}
+
+struct model *obj_parse(const char *text, size_t size, const char *name)
+{
+	struct model *model = calloc(1, sizeof(struct model));
+	if (!model) {
+		log_err("out of memory parsing %s", name);
+		return NULL;
+	}
+	uint32_t vertex_cap = 0, index_cap = 0;
+	int line_no = 0;
+	const char *text_end = text + size;
+
+	for (const char *line = text; line < text_end;) {
+		++line_no;
+		const char *end = memchr(line, '\n', text_end - line);
+		if (!end)
+			end = text_end;
+		const char *next = end + 1;
+		// comments may also follow the data on a line
+		const char *comment = memchr(line, '#', end - line);
+		if (comment)
+			end = comment;
+		const char *s = skip_spaces(line, end);
+		line = next;
+
+		if (at(s, end) == 'v' && is_space(at(s + 1, end))) {
+			if (!reserve((void **)&model->vertices, &vertex_cap,
+				     model->vertex_count + 1, sizeof(vec3)))
+				goto oom;
+			float *v = model->vertices[model->vertex_count];
+			++s;
+			for (int i = 0; i < 3; ++i) {
+				s = parse_float(skip_spaces(s, end), end,
+						&v[i]);
+				if (!s)
+					goto malformed;
+			}
+			++model->vertex_count;
+		} else if (at(s, end) == 'f' && is_space(at(s + 1, end))) {
+			// corners are v, v/vt, v/vt/vn or v//vn. only v is
+			// used, negative indices count back from the last
+			// vertex so far
+			uint16_t corners[OBJ_MAX_FACE_CORNERS];
+			int num_corners = 0;
+			s = skip_spaces(s + 1, end);
+			while (s < end) {
+				long idx;
+				s = parse_int(s, end, &idx);
+				if (!s || num_corners == OBJ_MAX_FACE_CORNERS)
+					goto malformed;
+				idx = idx < 0 ? (long)model->vertex_count + idx
+					      : idx - 1;
+				if (idx < 0 || idx >= model->vertex_count)
+					goto malformed;
+				if (idx > UINT16_MAX) {
+					log_err("%s has too many vertices for 16 bit indices",
+						name);
+					obj_free(model);
+					return NULL;
+				}
+				corners[num_corners++] = (uint16_t)idx;
+				while (s < end && !is_space(*s))
+					++s;
+				s = skip_spaces(s, end);
+			}
+			if (num_corners < 3)
+				goto malformed;
+
+			uint32_t num_indices = 3 * (num_corners - 2);
+			if (!reserve((void **)&model->indices, &index_cap,
+				     model->index_count + num_indices,
+				     sizeof(uint16_t)))
+				goto oom;
+			uint16_t *out = &model->indices[model->index_count];
+			for (int i = 1; i + 1 < num_corners; ++i) {
+				*out++ = corners[0];
+				*out++ = corners[i];
+				*out++ = corners[i + 1];
+			}
+			model->index_count += num_indices;
+		}
+		// vt, vn, comments, groups, materials etc. are skipped
+	}
+
+	model->name = strdup(name);
+	if (!model->name)
+		goto oom;
+	log_info("parsed model %s containing %u vertices and %u triangles",
+		 name, model->vertex_count, model->index_count / 3);
+	return model;
+
+malformed:
+	log_err("malformed obj %s at line %d", name, line_no);
+	obj_free(model);
+	return NULL;
+oom:
+	log_err("out of memory parsing %s", name);
+	obj_free(model);
+	return NULL;
+}
+
+struct model *obj_cache_load(struct asset *cache, const char *name,
+			     const struct obj_stamp *stamp)
+{
+	const struct obj_cache_header *header = (const void *)cache->data;
+	bool valid = cache->size >= sizeof(*header);
+	if (valid) {
+		size_t expected =
+			sizeof(*header) +
+			(size_t)header->vertex_count * sizeof(vec3) +
+			(size_t)header->index_count * sizeof(uint16_t);
+		valid = header->magic == OBJ_CACHE_MAGIC &&
+			header->version == OBJ_CACHE_VERSION &&
+			expected == cache->size;
+	}
+	if (valid && stamp)
+		valid = header->stamp.size == stamp->size &&
+			header->stamp.mtime == stamp->mtime;
+	if (!valid) {
+		log_info("mesh cache of %s is stale", name);
+		asset_close(cache);
+		return NULL;
+	}
+
+	struct model *model = calloc(1, sizeof(struct model));
+	if (!model) {
+		log_err("out of memory loading mesh cache of %s", name);
+		asset_close(cache);
+		return NULL;
+	}
+	model->vertices = (vec3 *)(cache->data + sizeof(*header));
+	model->indices = (uint16_t *)(model->vertices + header->vertex_count);
+	model->vertex_count = header->vertex_count;
+	model->index_count = header->index_count;
+	model->cache = *cache;
+	*cache = (struct asset){ 0 };
+	model->name = strdup(name);
+	if (!model->name) {
+		log_err("out of memory loading mesh cache of %s", name);
+		obj_free(model);
+		return NULL;
+	}
+	log_info("mapped model %s containing %u vertices and %u triangles",
+		 name, model->vertex_count, model->index_count / 3);
+	return model;
+}
+
+bool obj_cache_write(const char *cache_file, const struct model *model,
+		     const struct obj_stamp *stamp)
+{
+	// written aside and renamed into place, a reader never maps half a
+	// cache
+	char tmp_file[PATH_MAX];
+	snprintf(tmp_file, sizeof(tmp_file), "%s.tmp", cache_file);
+	FILE *fp = fopen(tmp_file, "wb");
+	if (!fp) {
+		log_warn("unable to write mesh cache %s", cache_file);
+		return false;
+	}
+
+	struct obj_cache_header header = {
+		.magic = OBJ_CACHE_MAGIC,
+		.version = OBJ_CACHE_VERSION,
+		.stamp = *stamp,
+		.vertex_count = model->vertex_count,
+		.index_count = model->index_count,
+	};
+	bool ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+	if (model->vertex_count)
+		ok &= fwrite(model->vertices, sizeof(vec3),
+			     model->vertex_count,
+			     fp) == model->vertex_count;
+	if (model->index_count)
+		ok &= fwrite(model->indices, sizeof(uint16_t),
+			     model->index_count, fp) == model->index_count;
+	ok &= fclose(fp) == 0;
+	if (!ok || rename(tmp_file, cache_file) != 0) {
+		log_warn("unable to write mesh cache %s", cache_file);
+		remove(tmp_file);
+		return false;
+	}
+	log_trace("wrote mesh cache %s", cache_file);
+	return true;
+}
+
+void obj_free(struct model *model)
+{
+	if (!model)
+		return;
+	if (model->cache.data) {
+		asset_close(&model->cache);
+	} else {
+		free(model->vertices);
+		free(model->indices);
+	}
+	free(model->name);
+	free(model);
+}
+
+void obj_print(const struct model *model)
+{
+	if (!log_enabled(LOG_TRACE))
+		return;
+	log_trace("printing model %s", model->name);
+	log_trace("vertices:");
+	for (uint32_t i = 0; i < model->vertex_count; i++) {
+		log_trace("(%f %f %f) ", model->vertices[i][0],
+			  model->vertices[i][1], model->vertices[i][2]);
+	}
+	log_trace("triangles:");
+	for (uint32_t i = 0; i + 2 < model->index_count; i += 3) {
+		log_trace("(%hu %hu %hu) ", model->indices[i],
+			  model->indices[i + 1], model->indices[i + 2]);
+	}
+}
@@ -0,0 +1,52 @@
+#ifndef OBJ_H
+#define OBJ_H
+
+#include "asset.h"
+
+#include "cglm/include/cglm/cglm.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// triangle mesh with positions only, which is all the renderer draws. either
+// parsed from obj text into heap arrays, or pointing straight into a mesh
+// cache asset
+struct model {
+	vec3 *vertices;
+	uint16_t *indices; // 3 per triangle
+	uint32_t vertex_count;
+	uint32_t index_count;
+	char *name;
+	// cache backing vertices and indices, no data if they are heap
+	// allocated
+	struct asset cache;
+};
+
+// identifies the obj a cache was built from, a cache is stale once the obj
+// no longer matches
+struct obj_stamp {
+	int64_t size;
+	int64_t mtime;
+};
+
+// parse size bytes of obj text in one pass. n-gon faces are
+// fan triangulated, so they are expected to be convex. texture coords and
+// normals are skipped. returns NULL on malformed input or if the model needs
+// more than 16 bit indices
+struct model *obj_parse(const char *text, size_t size, const char *name);
+
+// use a mesh cache written by obj_cache_write() in place. if stamp isn't
+// NULL the cache must have been written for that obj. takes the cache asset,
+// which is closed along with the model, or right away if it isn't valid
+struct model *obj_cache_load(struct asset *cache, const char *name,
+			     const struct obj_stamp *stamp);
+
+// write model as a cache, so later runs can map it instead of parsing
+bool obj_cache_write(const char *cache_file, const struct model *model,
+		     const struct obj_stamp *stamp);
+
+void obj_free(struct model *model);
+void obj_print(const struct model *model);
+
+#endif
@@ -0,0 +1,105 @@
+#include "predict.h"
+#include "game.h"
+#include "log.h"
+#include "turn.h"
+
+#include <assert.h>
+
+// tile shift of each move, the inverse of shift_to_move_dir in game.c
+static const int8_t move_shift[MOVE_COUNT][2] = {
+	[MOVE_N] = { -1, 0 },  [MOVE_E] = { 0, 1 },   [MOVE_S] = { 1, 0 },
+	[MOVE_W] = { 0, -1 },  [MOVE_NE] = { -1, 1 }, [MOVE_SE] = { 1, 1 },
+	[MOVE_SW] = { 1, -1 }, [MOVE_NW] = { -1, -1 },
+};
+
+// last tile the server agreed to
+static int confirmed_x, confirmed_y;
+
+// moves applied locally but not answered yet, oldest first. every one is a
+// queued turn, so the turn queue bounds them
+static enum move_direction pending[TURN_QUEUE_LEN];
+static int pending_head;
+static int pending_len;
+
+static uint64_t corrections;
+
+void predict_init(const struct game_context *ctx)
+{
+	confirmed_x = ctx->player->pos_x;
+	confirmed_y = ctx->player->pos_y;
+	pending_head = 0;
+	pending_len = 0;
+}
+
+uint64_t predict_corrections(void)
+{
+	return corrections;
+}
+
+void predict_step(enum move_direction move, struct game_context *ctx)
+{
+	struct player *player = ctx->player;
+	int x = player->pos_x + move_shift[move][0];
+	int y = player->pos_y + move_shift[move][1];
+	if (map_passable(&ctx->map, x, y))
+		player_move_to(player, x, y);
+}
+
+// replay the pending moves from the confirmed tile, skipping any the cached
+// map now says are blocked, and correct the player if it ends up elsewhere
+static void reconcile(struct game_context *ctx)
+{
+	int x = confirmed_x;
+	int y = confirmed_y;
+	for (int i = 0; i < pending_len; ++i) {
+		enum move_direction move =
+			pending[(pending_head + i) % TURN_QUEUE_LEN];
+		int next_x = x + move_shift[move][0];
+		int next_y = y + move_shift[move][1];
+		if (map_passable(&ctx->map, next_x, next_y)) {
+			x = next_x;
+			y = next_y;
+		}
+	}
+
+	struct player *player = ctx->player;
+	if (x == player->pos_x && y == player->pos_y)
+		return;
+	log_info("correcting predicted (%d,%d) to (%d,%d)", player->pos_x,
+		 player->pos_y, x, y);
+	player_move_to(player, x, y);
+	++corrections;
+}
+
+static void move_done(const struct turn *turn, bool success,
+		      struct game_context *ctx)
+{
+	// turns complete in submission order, so this is the oldest move
+	assert(pending_len > 0);
+	enum move_direction move = pending[pending_head];
+	pending_head = (pending_head + 1) % TURN_QUEUE_LEN;
+	--pending_len;
+
+	if (success) {
+		confirmed_x += move_shift[move][0];
+		confirmed_y += move_shift[move][1];
+	} else {
+		log_info("move %d refused", move);
+	}
+	// the response may also have changed the map under later moves
+	reconcile(ctx);
+}
+
+bool predict_submit(const struct turn *turn, struct game_context *ctx)
+{
+	assert(turn->type == TURN_MOVE);
+	if (!turn_submit(turn, move_done)) {
+		reconcile(ctx);
+		return false;
+	}
+	assert(pending_len < TURN_QUEUE_LEN);
+	pending[(pending_head + pending_len) % TURN_QUEUE_LEN] =
+		turn->value.move;
+	++pending_len;
+	return true;
+}
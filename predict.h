@@ -0,0 +1,37 @@
+#ifndef PREDICT_H
+#define PREDICT_H
+
+struct game_context;
+
+#include "turn.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// client side movement prediction. a move is applied to the player as soon
+// as it is made and logged until the server answers its turn. the answers
+// move the confirmed position, and after each one the logged moves are
+// replayed on top of it against the cached map. if that disagrees with where
+// the player is shown, e.g. the server refused a move or a wall turned up,
+// the player is put back on the replayed tile
+
+// every TURN_MOVE that shifts the player goes through predict_submit(), the
+// confirmed tile drifts from the server's otherwise. MOVE_WAIT turns don't
+// move anyone and may use turn_submit() directly
+
+// the player's current tile is taken as confirmed. call once the player is
+// placed and before any move is submitted
+void predict_init(const struct game_context *ctx);
+
+// move the player a tile ahead of the server, if the cached map allows.
+// for moves not made by walking the camera, e.g. key presses
+void predict_step(enum move_direction move, struct game_context *ctx);
+
+// turn_submit() a move the player has already made locally, undoing it if
+// the turn can't be queued
+bool predict_submit(const struct turn *turn, struct game_context *ctx);
+
+// times the shown position had to be corrected
+uint64_t predict_corrections(void);
+
+#endif
@@ -1,5 +1,11 @@
 #include "render.h"
+#include "cull.h"
 #include "log.h"
+#include "map_instance.h"
+#include "asset.h"
+#include "mesher.h"
+#include "obj.h"
+#include "startup.h"
 
 // TODO: add cglm/include to include path
 #include "cglm/include/cglm/cglm.h"
@@ -7,6 +13,7 @@
 #include <limits.h>
 #include <math.h>
 #include <SDL3/SDL.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -17,8 +24,28 @@
 #define WIN_W 1920
 #define WIN_H 1080
 
-char shader_path[PATH_MAX];
-char resource_path[PATH_MAX];
+// how map cells reach the screen, picked with AN_MAP_PATH at startup.
+// TERRAIN greedy meshes the level per chunk: the fewest triangles and no per
+// tile work while the view moves, but every change to a chunk remeshes it on
+// the cpu. the other two draw each cell as an instanced cube and cull the
+// cubes every time the view moves, GPU_CULL in a compute pass, CPU_CULL with
+// the simd kernels in cull.c. they trade more vertices for no meshing, which
+// pays off when cells change most turns. a path that can't be set up falls
+// back to the next one down
+enum map_path {
+	MAP_PATH_TERRAIN,
+	MAP_PATH_GPU_CULL,
+	MAP_PATH_CPU_CULL,
+	MAP_PATH_COUNT
+};
+
+static const char map_path_env_key[] = "AN_MAP_PATH";
+
+static const char *map_path_names[MAP_PATH_COUNT] = {
+	[MAP_PATH_TERRAIN] = "TERRAIN",
+	[MAP_PATH_GPU_CULL] = "GPU_CULL",
+	[MAP_PATH_CPU_CULL] = "CPU_CULL",
+};
 
 static const vec4 map_type_color[MTYPE_COUNT] = {
 	[MTYPE_NONE] = {0.5f, 0.0f, 0.0f, 1.0f,},
@@ -28,264 +55,290 @@ static const vec4 map_type_color[MTYPE_COUNT] = {
 	[MTYPE_UNKNOWN] = { 0.0f, 0.5f, 0.5f, 1.0f },
 };
 
-// for now don't support normal index:
-struct face {
-	Uint16 v_idx[3];
-	Uint16 t_idx[3];
-};
-
 enum model_type {
 	MODEL_ACTOR, // default
 	MODEL_MAP,
+	MODEL_TERRAIN, // meshed map chunks, see mesher.h
+	MODEL_TERRAIN_DEPTH, // depth only pre-pass of the terrain
 	MODEL_COUNT
 };
 
-struct model {
-	vec3 *vertices;
-	vec2 *uvs;
-	struct face *faces;
-	size_t vertex_count;
-	size_t uv_count;
-	size_t face_count;
-	char *name;
-	enum model_type type;
+// every shader a pipeline uses, each is loaded once however many pipelines
+// share it
+enum shader_id {
+	SHADER_MAP_VERT,
+	SHADER_TERRAIN_VERT,
+	SHADER_VERT_COLOR_FRAG,
+	SHADER_COUNT
+};
+
+struct shader_source {
+	const char *file; // without the backend extension
+	Uint32 num_uniform_buffers;
+	Uint32 num_storage_buffers;
+};
+
+static const struct shader_source shader_sources[SHADER_COUNT] = {
+	[SHADER_MAP_VERT] = { "position_color_shifted.vert", 1, 0 },
+	[SHADER_TERRAIN_VERT] = { "terrain.vert", 1, 0 },
+	[SHADER_VERT_COLOR_FRAG] = { "vert_input_color.frag", 0, 0 },
+};
+
+struct pipeline_source {
+	const char *name; // NULL if the pipeline isn't built
+	enum shader_id vert, frag;
+	bool required; // optional pipelines fall back to other paths
+};
+
+// actors are drawn by the map pipeline for now
+static const struct pipeline_source pipeline_sources[MODEL_COUNT] = {
+	[MODEL_MAP] = { "map", SHADER_MAP_VERT, SHADER_VERT_COLOR_FRAG, true },
+	[MODEL_TERRAIN] = { "terrain", SHADER_TERRAIN_VERT,
+			    SHADER_VERT_COLOR_FRAG, false },
+	[MODEL_TERRAIN_DEPTH] = { "terrain depth", SHADER_TERRAIN_VERT,
+				  SHADER_VERT_COLOR_FRAG, false },
+};
+
+// the terrain depth pre-pass lays down the terrain's depth before anything
+// is shaded, so later passes shade each covered pixel once. on by default,
+// AN_DEPTH_PREPASS=0 turns it off, e.g. to compare frame times without it
+static const char depth_prepass_env_key[] = "AN_DEPTH_PREPASS";
+
+// worker threads for the startup jobs, including the main thread
+#define RENDER_INIT_THREADS 8
+
+// palette slots in the shader, at least MTYPE_COUNT
+#define MAP_PALETTE_LEN 8
+_Static_assert(MTYPE_COUNT <= MAP_PALETTE_LEN, "map palette too small");
+
+// vertex uniforms of the map pipeline, matches the UBO cbuffer
+struct map_uniforms {
+	mat4 viewproj;
+	vec4 palette[MAP_PALETTE_LEN];
+};
+
+// meshes share one vertex and one index buffer, each has its own range of the
+// instance buffer and one indirect draw command, so a single multi-draw covers
+// every mesh type. actors (monkey.obj) get an entry once the game has
+// entities to write their instances from
+enum mesh_id {
+	MESH_TILE, // map cells
+	MESH_COUNT
+};
+
+struct mesh_source {
+	const char *file;
+	Uint32 max_instances;
+	bool required; // optional meshes are drawn as nothing if missing
+};
+
+static const struct mesh_source mesh_sources[MESH_COUNT] = {
+	[MESH_TILE] = { "cube.obj", MAP_CELLS, true },
+};
+
+struct mesh {
+	Uint32 first_index;
+	Uint32 num_indices; // 0 if the mesh didn't load
+	Sint32 vertex_offset;
+	Uint32 first_instance; // start of the mesh's instance range
+	Uint32 num_instances; // as last written to the draw commands
+};
+
+// clean instances between two dirty runs are uploaded along with them if the
+// gap is at most this long, fewer larger copies beat many tiny ones
+#define MAP_UPLOAD_GAP 8
+
+struct instance_range {
+	Uint32 first, count;
+};
+
+// terrain chunks own fixed slots of the terrain vertex and index buffers
+// big enough for their worst case, so remeshing one never moves the others
+struct terrain_chunk {
+	Uint32 num_indices; // 0 if the chunk has no faces
+	vec3 min, max; // world space bounds
+};
+
+#define TERRAIN_CHUNK_UPLOAD_SIZE                                    \
+	(TERRAIN_CHUNK_MAX_VERTICES * sizeof(struct terrain_vertex) + \
+	 TERRAIN_CHUNK_MAX_INDICES * sizeof(Uint16))
+// chunks remeshed per frame at most, the rest wait for the next frames.
+// bounds the upload size when a level change dirties everything
+#define TERRAIN_UPLOAD_CHUNKS 8
+
+#define RENDER_FRAMES_IN_FLIGHT 3
+
+// transfer buffer layout: the mesh draw commands, the terrain draw commands,
+// the dirty instance runs, then the remeshed terrain chunks
+#define FRAME_UPLOAD_TERRAIN_DRAWS_OFFSET 64
+_Static_assert(MESH_COUNT * sizeof(SDL_GPUIndexedIndirectDrawCommand) <=
+		       FRAME_UPLOAD_TERRAIN_DRAWS_OFFSET,
+	       "draw commands overlap the terrain draw commands");
+#define FRAME_UPLOAD_INSTANCES_OFFSET 576
+_Static_assert(FRAME_UPLOAD_TERRAIN_DRAWS_OFFSET +
+			       MAP_LEVEL_CHUNKS *
+				       sizeof(SDL_GPUIndexedIndirectDrawCommand) <=
+		       FRAME_UPLOAD_INSTANCES_OFFSET,
+	       "terrain draw commands overlap the instances");
+#define FRAME_UPLOAD_TERRAIN_OFFSET      \
+	(FRAME_UPLOAD_INSTANCES_OFFSET + \
+	 MAP_CELLS * sizeof(struct gpu_map_instance))
+#define FRAME_UPLOAD_SIZE              \
+	(FRAME_UPLOAD_TERRAIN_OFFSET + \
+	 TERRAIN_UPLOAD_CHUNKS * TERRAIN_CHUNK_UPLOAD_SIZE)
+
+struct frame_upload {
+	SDL_GPUTransferBuffer *trans_buf;
+	// signalled once the gpu is done with the frame that last used
+	// trans_buf, NULL if that frame has no fence to wait on
+	SDL_GPUFence *fence;
+};
+
+// compute uniforms of cull_tiles.comp
+struct cull_uniforms {
+	vec4 planes[6];
+	Uint32 tile_count;
+	Uint32 first_instance;
+	Uint32 draw_count_offset; // byte offset of the tile num_instances
+	Uint32 pad;
 };
 
 struct render_context {
 	struct render_info *rend_info;
 	SDL_GPUDevice *gpu_dev;
 	SDL_GPUGraphicsPipeline *pipeline;
-
-	// add more sophisticated grouping of buffers here
+	// sized to the swapchain texture, recreated when that changes
+	SDL_GPUTexture *depth_tex;
+	SDL_GPUTextureFormat depth_format;
+	Uint32 depth_w, depth_h;
+	enum map_path map_path; // requested, then the one set up
+	// frustum culls the map tiles from tile_buf into the instance buffer.
+	// only built for MAP_PATH_GPU_CULL
+	SDL_GPUComputePipeline *cull_pipeline;
+	SDL_GPUBuffer *tile_buf;
+	// static terrain drawn from per chunk meshes instead of tile cubes.
+	// only built for MAP_PATH_TERRAIN
+	SDL_GPUGraphicsPipeline *terrain_pipeline;
+	SDL_GPUGraphicsPipeline *terrain_depth_pipeline; // NULL if no pre-pass
+	SDL_GPUBuffer *terrain_vertex_buf;
+	SDL_GPUBuffer *terrain_index_buf;
+	SDL_GPUBuffer *terrain_draw_buf; // MAP_LEVEL_CHUNKS draw commands
+	struct terrain_chunk terrain_chunks[MAP_LEVEL_CHUNKS];
+	bool terrain_dirty[MAP_LEVEL_CHUNKS]; // needs remeshing
+
+	// every mesh packed together, see struct mesh
 	SDL_GPUBuffer *vertex_buf;
 	SDL_GPUBuffer *index_buf;
-	SDL_GPUBuffer *draw_buf;
-	SDL_GPUBuffer
-		*map_data_buf; // store the ByteAddressBuffer data_buffer data
-	SDL_GPUTransferBuffer *map_data_pos_trans_buf;
-	SDL_GPUTransferBuffer *map_data_draw_trans_buf;
-	struct model *tile_cube;
-	struct map_pos_info last_frame_map[MAX_MAP_VISIBLE];
-	bool last_frame_changed;
+	SDL_GPUBuffer *draw_buf; // MESH_COUNT indirect draw commands
+	SDL_GPUBuffer *instance_buf; // per mesh instance ranges
+	struct mesh meshes[MESH_COUNT];
+	// map uploads go through a ring of transfer buffers, one per frame in
+	// flight, so writing the next frame's data never waits on the gpu
+	// still reading the previous one
+	struct frame_upload frames[RENDER_FRAMES_IN_FLIGHT];
+	int frame_index;
+	// one instance per non-empty map cell, kept contiguous so the tile
+	// draw covers [0, num_map_instances). stored as streams for the cull
+	// kernels, and only packed when uploading
+	uint16_t instance_cell[MAP_CELLS]; // map cell per instance
+	int16_t instance_x[MAP_CELLS];
+	int16_t instance_y[MAP_CELLS];
+	uint8_t instance_type[MAP_CELLS]; // enum map_type per instance
+	int num_map_instances;
+	int16_t cell_instance[MAP_CELLS]; // instance per map cell, -1 if empty
+	// instances changed since the last upload, [lo, hi] bounds the set bits
+	uint64_t dirty_instance_bits[(MAP_CELLS + 63) / 64];
+	int dirty_instance_lo, dirty_instance_hi;
+	// runs of this frame's upload, runs are at least MAP_UPLOAD_GAP apart
+	struct instance_range upload_ranges[MAP_CELLS / (MAP_UPLOAD_GAP + 1) + 1];
+	// without the cull pass tiles are culled on the cpu into visible,
+	// again whenever the view or the tiles change. terrain chunks are
+	// culled the same way
+	uint32_t visible[MAP_CELLS];
+	mat4 culled_viewproj;
 };
 
 struct render_info rend_info;
 struct render_context rend_ctx;
 
-static void free_model(struct model *m)
-{
-	if (!m)
-		return;
-	free(m->vertices);
-	free(m->uvs);
-	free(m->faces);
-	free(m->name);
-	free(m);
-}
-
-void print_model(const struct model *m)
-{
-	log_trace("printing model %s", m->name);
-	log_trace("vertices:");
-	for (int i = 0; i < m->vertex_count; i++) {
-		log_trace("(%f %f %f) ", m->vertices[i][0], m->vertices[i][1],
-			  m->vertices[i][2]);
-	}
-	log_trace("uvs:");
-	for (int i = 0; i < m->uv_count; i++) {
-		log_trace("(%f %f) ", m->uvs[i][0], m->uvs[i][1]);
-	}
-	log_trace("face vertices:");
-	for (int i = 0; i < m->face_count; i++) {
-		log_trace("(%hu %hu %hu) ", m->faces[i].v_idx[0],
-			  m->faces[i].v_idx[1], m->faces[i].v_idx[2]);
-	}
-}
-
-static char *load_file(const char *file, size_t *size)
+// obj files are parsed once and cached next to themselves as <file>.cache,
+// later runs map the cache instead. a cache without its obj is used as is
+static struct model *load_obj(const char *file)
 {
-	if (!file || !size) {
+	char name[PATH_MAX];
+	char cache_name[PATH_MAX];
+	int n = snprintf(name, sizeof(name), "resources/%s", file);
+	if (n < 0 || n >= (int)sizeof(name)) {
+		log_err("obj path too long: resources/%s", file);
 		return NULL;
 	}
-	*size = 0;
-	FILE *fp = fopen(file, "r");
-	if (!fp) {
-		log_err("fopen error for %s", file);
+	n = snprintf(cache_name, sizeof(cache_name), "%s.cache", name);
+	if (n < 0 || n >= (int)sizeof(cache_name)) {
+		log_err("obj cache path too long: %s.cache", name);
 		return NULL;
 	}
 
-	struct stat st;
-	if (fstat(fileno(fp), &st) == -1) {
-		perror("fstat error\n");
-		fclose(fp);
-		return NULL;
+	struct asset obj;
+	bool have_obj = asset_open(name, &obj);
+	struct obj_stamp stamp = {};
+	if (have_obj)
+		stamp = (struct obj_stamp){ (int64_t)obj.size, obj.mtime };
+
+	struct asset cache;
+	if (asset_open(cache_name, &cache)) {
+		struct model *model = obj_cache_load(
+			&cache, file, have_obj ? &stamp : NULL);
+		if (model) {
+			if (have_obj)
+				asset_close(&obj);
+			return model;
+		}
 	}
+	if (!have_obj)
+		return NULL;
 
-	char *filebuf = malloc(st.st_size + 1);
-	if (fread(filebuf, st.st_size, 1, fp) != 1) {
-		log_err("fread error");
-		free(filebuf);
-		filebuf = NULL;
-	} else {
-		filebuf[st.st_size] = '\0';
-		*size = st.st_size;
+	struct model *model = obj_parse(obj.data, obj.size, file);
+	asset_close(&obj);
+	if (model) {
+		char cache_file[PATH_MAX];
+		asset_path(cache_name, cache_file, PATH_MAX);
+		obj_cache_write(cache_file, model, &stamp);
 	}
-	fclose(fp);
-
-	return filebuf;
+	return model;
 }
 
-// load full buffer
-// readline with strchr('\n')
-// find first word in line, use small word buffer, categorize as {#, v, vt, vn, vp, f, l}
-// count nums of each element, malloc structures
-// re-read, parse into data structures
-static struct model *load_obj(const char *file)
+// open the compiled shader for the device's backend, caller closes
+static bool load_shader_code(SDL_GPUDevice *device, const char *filename,
+			     SDL_GPUShaderFormat *format,
+			     const char **entrypoint, struct asset *code)
 {
-	char full_file[PATH_MAX];
-	snprintf(full_file, PATH_MAX, "%s/%s", resource_path, file);
-	size_t fsize;
-	char *filebuf = load_file(full_file, &fsize);
-
-	struct model *model = calloc(1, sizeof(struct model));
-
-	// ignore in return for now:
-	size_t normal_count = 0;
-	size_t parameter_count = 0;
-	size_t line_count = 0;
-
-	char *line = filebuf;
-	int matched_vals = 0;
-	// typeword in: {#, v, vt, vn, vp, f, l} + '\0'
-	char typeword[3] = { 0 };
-	do {
-		matched_vals = sscanf(line, "%2s", typeword);
-		if (matched_vals == EOF || matched_vals < 1) {
-			log_err("fprintf err, line");
-			free(filebuf);
-			free_model(model);
-			return NULL;
-		}
-
-		if (strcmp(typeword, "v") == 0) {
-			model->vertex_count++;
-		} else if (strcmp(typeword, "vt") == 0) {
-			model->uv_count++;
-		} else if (strcmp(typeword, "vn") == 0) {
-			++normal_count;
-		} else if (strcmp(typeword, "vp") == 0) {
-			++parameter_count;
-		} else if (strcmp(typeword, "f") == 0) {
-			// TODO: for now expect triangular faces e.g. f # # #,
-			// f #/# #/# #/#, f #/#/# #/#/# #/#/#, or f #//# #//# #//#
-			model->face_count++;
-		} else if (strcmp(typeword, "l") == 0) {
-			++line_count;
-		} else if (strcmp(typeword, "#") == 0) {
-			int line_len = strchr(line, '\n') - line;
-			log_trace("read comment: %.*s", line_len, line);
-		} else {
-			continue;
-		}
-	} while ((line = strchr(line, '\n')) != NULL && *(++line) != '\0');
-
-	model->vertices = calloc(model->vertex_count, sizeof(vec3));
-	model->uvs = calloc(model->uv_count, sizeof(vec2));
-	model->faces = calloc(model->face_count, sizeof(struct face));
-
-	size_t cur_v = 0;
-	size_t cur_f = 0;
-	size_t cur_tex = 0;
-
-	line = filebuf;
-	int typewordlen;
-	do {
-		matched_vals = sscanf(line, "%2s%n", typeword, &typewordlen);
-		if (matched_vals == EOF || matched_vals < 1) {
-			log_err("fprintf err");
-			free(filebuf);
-			free_model(model);
-			return NULL;
-		}
-		line += typewordlen;
-
-		if (strcmp(typeword, "v") == 0) {
-			sscanf(line, "%f %f %f", &(model->vertices[cur_v][0]),
-			       &(model->vertices[cur_v][1]),
-			       &(model->vertices[cur_v][2]));
-			++cur_v;
-		} else if (strcmp(typeword, "vt") == 0) {
-			sscanf(line, "%f %f", &(model->uvs[cur_tex][0]),
-			       &(model->uvs[cur_tex][1]));
-			++cur_tex;
-		} else if (strcmp(typeword, "f") == 0) {
-			// NOTE: the obj format is 1-indexed. -1 is the last element etc. Need to correct to 0-indexed here
-
-			// TODO: for now expect triangular faces e.g. f # # #, f #/# #/# #/#,
-			// f #/#/# #/#/# #/#/#, or f #//# #//# #//#
-			// how to separate 1 2 3 vs 1/# 2/# 3/# ?
-			// TODO: if every line is of same type, only need to determine this
-			// once vs trying all 3 for each vertex.
-
-			// for # # #:
-			matched_vals = sscanf(line, "%hu %hu %hu",
-					      &(model->faces[cur_f].v_idx[0]),
-					      &(model->faces[cur_f].v_idx[1]),
-					      &(model->faces[cur_f].v_idx[2]));
-			if (matched_vals < 3) {
-				// for #/# #/# #/#:
-				matched_vals =
-					sscanf(line, "%hu/%hu %hu/%hu %hu/%hu",
-					       &(model->faces[cur_f].v_idx[0]),
-					       &(model->faces[cur_f].t_idx[0]),
-					       &(model->faces[cur_f].v_idx[1]),
-					       &(model->faces[cur_f].t_idx[1]),
-					       &(model->faces[cur_f].v_idx[2]),
-					       &(model->faces[cur_f].t_idx[2]));
-				if (matched_vals < 6) {
-					int line_len =
-						strchr(line, '\n') - line;
-					log_warn(
-						"currently don't support face formats beyond # # #,"
-						" and #/# #/# #/#, got %.*s",
-						line_len, line);
-				}
-			}
+	SDL_GPUShaderFormat backend_formats = SDL_GetGPUShaderFormats(device);
+	const char *extension;
+	char name[PATH_MAX];
 
-			// switch to 0-based indexing
-			--(model->faces[cur_f].v_idx[0]);
-			--(model->faces[cur_f].v_idx[1]);
-			--(model->faces[cur_f].v_idx[2]);
-
-			++cur_f;
-			// } else if (strcmp(typeword, "vn") == 0) {
-			// 	continue;
-			// } else if (strcmp(typeword, "vp") == 0) {
-			// 	continue;
-			// } else if (strcmp(typeword, "l") == 0) {
-			// 	continue;
-			// } else if (strcmp(typeword, "#") == 0) {
-			// 	continue;
-		} else {
-			continue;
-		}
-	} while ((line = strchr(line, '\n')) != NULL && *(++line) != '\0');
-	free(filebuf);
-
-	if (cur_v != model->vertex_count || cur_tex != model->uv_count ||
-	    cur_f != model->face_count) {
-		log_err("could not correctly load all model data from %s",
-			file);
-		free_model(model);
-		return NULL;
+	if (backend_formats & SDL_GPU_SHADERFORMAT_SPIRV) {
+		*format = SDL_GPU_SHADERFORMAT_SPIRV;
+		extension = ".spv";
+		*entrypoint = "main";
+	} else if (backend_formats & SDL_GPU_SHADERFORMAT_MSL) {
+		*format = SDL_GPU_SHADERFORMAT_MSL;
+		extension = ".msl";
+		*entrypoint = "main0";
+	} else if (backend_formats & SDL_GPU_SHADERFORMAT_DXIL) {
+		*format = SDL_GPU_SHADERFORMAT_DXIL;
+		extension = ".dxil";
+		*entrypoint = "main";
+	} else {
+		log_err("unrecognized backend shader format");
+		return false;
 	}
+	snprintf(name, PATH_MAX, "shaders/%s%s", filename, extension);
 
-	log_trace(
-		"loaded model %s containing %ld vertices, %ld texture coords, and %ld faces\n",
-		file, model->vertex_count, model->uv_count, model->face_count);
-	model->name = strdup(file);
-	print_model(model);
-	return model;
+	if (!asset_open(name, code)) {
+		log_err("unable to open shader %s", name);
+		return false;
+	}
+	return true;
 }
 
 static SDL_GPUShader *load_shader(SDL_GPUDevice *device, const char *filename,
@@ -304,43 +357,15 @@ static SDL_GPUShader *load_shader(SDL_GPUDevice *device, const char *filename,
 		return NULL;
 	}
 
-	SDL_GPUShaderFormat backend_formats = SDL_GetGPUShaderFormats(device);
-	SDL_GPUShaderFormat format = SDL_GPU_SHADERFORMAT_INVALID;
+	SDL_GPUShaderFormat format;
 	const char *entrypoint;
-	const char *extension;
-	char full_shader_path[PATH_MAX];
-
-	int pos = snprintf(full_shader_path, PATH_MAX, "%s/%s", shader_path,
-			   filename);
-
-	if (backend_formats & SDL_GPU_SHADERFORMAT_SPIRV) {
-		format = SDL_GPU_SHADERFORMAT_SPIRV;
-		extension = ".spv";
-		entrypoint = "main";
-	} else if (backend_formats & SDL_GPU_SHADERFORMAT_MSL) {
-		format = SDL_GPU_SHADERFORMAT_MSL;
-		extension = ".msl";
-		entrypoint = "main0";
-	} else if (backend_formats & SDL_GPU_SHADERFORMAT_DXIL) {
-		format = SDL_GPU_SHADERFORMAT_DXIL;
-		extension = ".dxil";
-		entrypoint = "main";
-	} else {
-		log_err("unrecognized backend shader format");
+	struct asset code;
+	if (!load_shader_code(device, filename, &format, &entrypoint, &code))
 		return NULL;
-	}
-	snprintf(full_shader_path + pos, PATH_MAX - pos, "%s", extension);
-
-	size_t fsize;
-	char *code = load_file(full_shader_path, &fsize);
-	if (!code) {
-		log_err("load_file error");
-		return NULL;
-	}
 
 	SDL_GPUShaderCreateInfo shader_info = {
-		.code = (Uint8 *)code,
-		.code_size = fsize,
+		.code = (const Uint8 *)code.data,
+		.code_size = code.size,
 		.entrypoint = entrypoint,
 		.format = format,
 		.stage = stage,
@@ -351,90 +376,162 @@ static SDL_GPUShader *load_shader(SDL_GPUDevice *device, const char *filename,
 	};
 	SDL_GPUShader *shader = SDL_CreateGPUShader(device, &shader_info);
 	if (!shader) {
-		log_err("failed to create shader");
+		log_err("failed to create shader %s", filename);
+	} else {
+		log_info("loaded shader %s", filename);
 	}
-
-	log_info("loaded shader %s", full_shader_path);
-	free(code);
+	asset_close(&code);
 	return shader;
 }
 
-// TODO: need to limit how many entities are valid? is that code correct?
-static bool upload_model(struct render_context *ctx, const struct model *model)
+#define CULL_THREADS 64
+
+static SDL_GPUComputePipeline *create_cull_pipeline(SDL_GPUDevice *device)
+{
+	SDL_GPUShaderFormat format;
+	const char *entrypoint;
+	struct asset code;
+	if (!load_shader_code(device, "cull_tiles.comp", &format, &entrypoint,
+			      &code))
+		return NULL;
+
+	SDL_GPUComputePipeline *pipeline = SDL_CreateGPUComputePipeline(
+		device, &(SDL_GPUComputePipelineCreateInfo){
+				.code = (const Uint8 *)code.data,
+				.code_size = code.size,
+				.entrypoint = entrypoint,
+				.format = format,
+				.num_readonly_storage_buffers = 1,
+				.num_readwrite_storage_buffers = 2,
+				.num_uniform_buffers = 1,
+				.threadcount_x = CULL_THREADS,
+				.threadcount_y = 1,
+				.threadcount_z = 1 });
+	if (!pipeline)
+		log_err("SDL_CreateGPUComputePipeline failed: %s",
+			SDL_GetError());
+	asset_close(&code);
+	return pipeline;
+}
+
+static void write_draw_commands(const struct render_context *ctx,
+				SDL_GPUIndexedIndirectDrawCommand *cmds)
+{
+	for (int i = 0; i < MESH_COUNT; ++i) {
+		const struct mesh *mesh = &ctx->meshes[i];
+		Uint32 num_instances = mesh->num_indices ? mesh->num_instances
+							 : 0;
+		// counted up by the cull pass every frame
+		if (i == MESH_TILE && ctx->cull_pipeline)
+			num_instances = 0;
+		cmds[i] = (SDL_GPUIndexedIndirectDrawCommand){
+			.num_indices = mesh->num_indices,
+			.num_instances = num_instances,
+			.first_index = mesh->first_index,
+			.vertex_offset = mesh->vertex_offset,
+			.first_instance = mesh->first_instance
+		};
+	}
+}
+
+// pack the loaded meshes into the shared vertex and index buffers, NULL
+// models didn't load. frees the models
+static bool upload_meshes(struct render_context *ctx,
+			  struct model *models[MESH_COUNT])
 {
-	// TODO: use model feature flags, or determine if size=0 to skip parts
-	log_trace("model upload started");
+	log_trace("mesh upload started");
+
+	Uint32 vertex_count = 0;
+	Uint32 index_count = 0;
+	Uint32 instance_count = 0;
+	for (int i = 0; i < MESH_COUNT; ++i) {
+		const struct mesh_source *src = &mesh_sources[i];
+		struct mesh *mesh = &ctx->meshes[i];
+
+		mesh->first_instance = instance_count;
+		instance_count += src->max_instances;
+
+		if (!models[i]) {
+			if (src->required) {
+				log_err("unable to load mesh %s", src->file);
+				for (int j = 0; j < MESH_COUNT; ++j)
+					obj_free(models[j]);
+				return false;
+			}
+			log_warn("unable to load mesh %s, not drawing it",
+				 src->file);
+			continue;
+		}
+		obj_print(models[i]);
 
-	const Uint32 vertex_buf_size = sizeof(vec3) * model->vertex_count;
+		mesh->first_index = index_count;
+		mesh->num_indices = models[i]->index_count;
+		mesh->vertex_offset = (Sint32)vertex_count;
+		vertex_count += models[i]->vertex_count;
+		index_count += mesh->num_indices;
+	}
+
+	const Uint32 vertex_buf_size = sizeof(vec3) * vertex_count;
 	ctx->vertex_buf = SDL_CreateGPUBuffer(
 		ctx->gpu_dev,
 		&(SDL_GPUBufferCreateInfo){ .usage = SDL_GPU_BUFFERUSAGE_VERTEX,
 					    .size = vertex_buf_size });
-	log_trace("vertices %d and size %lu", model->vertex_count,
-		  vertex_buf_size);
+	log_trace("vertices %u and size %u", vertex_count, vertex_buf_size);
 
-	// 3 vertex indices per triangle face
-	const Uint32 index_buf_size = sizeof(Uint16) * 3 * model->face_count;
+	// 3 vertex indices per triangle face, relative to the mesh's
+	// vertex_offset so 16 bits stay enough
+	const Uint32 index_buf_size = sizeof(Uint16) * index_count;
 	ctx->index_buf = SDL_CreateGPUBuffer(
 		ctx->gpu_dev,
 		&(SDL_GPUBufferCreateInfo){ .usage = SDL_GPU_BUFFERUSAGE_INDEX,
 					    .size = index_buf_size });
-	log_trace("faces %d and size %lu", model->face_count, index_buf_size);
+	log_trace("indices %u and size %u", index_count, index_buf_size);
 
-	// only 1 draw per model
-	// TODO move out of model?
 	const Uint32 draw_buf_size =
-		sizeof(SDL_GPUIndexedIndirectDrawCommand) * 1;
+		sizeof(SDL_GPUIndexedIndirectDrawCommand) * MESH_COUNT;
 	ctx->draw_buf = SDL_CreateGPUBuffer(
 		ctx->gpu_dev, &(SDL_GPUBufferCreateInfo){
-				      .usage = SDL_GPU_BUFFERUSAGE_INDIRECT,
+				      .usage = SDL_GPU_BUFFERUSAGE_INDIRECT |
+					       SDL_GPU_BUFFERUSAGE_COMPUTE_STORAGE_WRITE,
 				      .size = draw_buf_size });
 
-	// single indexed draw, set the N visible tiles:
-	rend_ctx.map_data_draw_trans_buf = SDL_CreateGPUTransferBuffer(
-		rend_ctx.gpu_dev,
-		&(SDL_GPUTransferBufferCreateInfo){
-			.usage = SDL_GPU_TRANSFERBUFFERUSAGE_UPLOAD,
-			.size = (Uint32)sizeof(
-					SDL_GPUIndexedIndirectDrawCommand) *
-				1 });
+	ctx->instance_buf = SDL_CreateGPUBuffer(
+		ctx->gpu_dev,
+		&(SDL_GPUBufferCreateInfo){
+			.usage = SDL_GPU_BUFFERUSAGE_VERTEX |
+				 SDL_GPU_BUFFERUSAGE_COMPUTE_STORAGE_WRITE,
+			.size = instance_count *
+				sizeof(struct gpu_map_instance) });
+
+	// draw commands (no instances yet) go after the indices
+	const Uint32 draw_trans_offset =
+		(vertex_buf_size + index_buf_size + 15) & ~(Uint32)15;
 
 	SDL_GPUTransferBuffer *trans_buf = SDL_CreateGPUTransferBuffer(
 		ctx->gpu_dev,
 		&(SDL_GPUTransferBufferCreateInfo){
 			.usage = SDL_GPU_TRANSFERBUFFERUSAGE_UPLOAD,
-			.size = vertex_buf_size + index_buf_size });
-
-	vec3 *vertex_trans = (vec3 *)SDL_MapGPUTransferBuffer(ctx->gpu_dev,
-							      trans_buf, false);
-	memcpy(vertex_trans, model->vertices,
-	       model->vertex_count * sizeof(vec3));
-
-	// or memcpy
-	Uint16 *index_trans = (Uint16 *)&vertex_trans[model->vertex_count];
-	for (int i = 0; i < model->face_count; i++) {
-		index_trans[3 * i] = model->faces[i].v_idx[0];
-		index_trans[3 * i + 1] = model->faces[i].v_idx[1];
-		index_trans[3 * i + 2] = model->faces[i].v_idx[2];
+			.size = draw_trans_offset + draw_buf_size });
+
+	Uint8 *trans = SDL_MapGPUTransferBuffer(ctx->gpu_dev, trans_buf, false);
+	vec3 *vertex_trans = (vec3 *)trans;
+	Uint16 *index_trans = (Uint16 *)(trans + vertex_buf_size);
+	for (int i = 0; i < MESH_COUNT; ++i) {
+		const struct model *model = models[i];
+		if (!model)
+			continue;
+		memcpy(vertex_trans, model->vertices,
+		       model->vertex_count * sizeof(vec3));
+		vertex_trans += model->vertex_count;
+		memcpy(index_trans, model->indices,
+		       model->index_count * sizeof(Uint16));
+		index_trans += model->index_count;
+		obj_free(models[i]);
 	}
-
+	write_draw_commands(ctx, (SDL_GPUIndexedIndirectDrawCommand
+					  *)(trans + draw_trans_offset));
 	SDL_UnmapGPUTransferBuffer(ctx->gpu_dev, trans_buf);
 
-	SDL_GPUIndexedIndirectDrawCommand *draw_trans =
-		(SDL_GPUIndexedIndirectDrawCommand *)SDL_MapGPUTransferBuffer(
-			ctx->gpu_dev, ctx->map_data_draw_trans_buf, true);
-
-	// TODO: for wall, have more num_instances
-	draw_trans[0] = (SDL_GPUIndexedIndirectDrawCommand){
-		.num_indices = (Uint32)(3 * model->face_count),
-		.num_instances = 1,
-		.first_index = 0,
-		.vertex_offset = 0,
-		.first_instance = 0
-	};
-
-	SDL_UnmapGPUTransferBuffer(ctx->gpu_dev, ctx->map_data_draw_trans_buf);
-
 	SDL_GPUCommandBuffer *cmd_buf =
 		SDL_AcquireGPUCommandBuffer(ctx->gpu_dev);
 	SDL_GPUCopyPass *copy_pass = SDL_BeginGPUCopyPass(cmd_buf);
@@ -458,9 +555,8 @@ static bool upload_model(struct render_context *ctx, const struct model *model)
 
 	SDL_UploadToGPUBuffer(copy_pass,
 			      &(SDL_GPUTransferBufferLocation){
-				      .transfer_buffer =
-					      ctx->map_data_draw_trans_buf,
-				      .offset = 0 },
+				      .transfer_buffer = trans_buf,
+				      .offset = draw_trans_offset },
 			      &(SDL_GPUBufferRegion){ .buffer = ctx->draw_buf,
 						      .offset = 0,
 						      .size = draw_buf_size },
@@ -470,71 +566,118 @@ static bool upload_model(struct render_context *ctx, const struct model *model)
 	SDL_SubmitGPUCommandBuffer(cmd_buf);
 	SDL_ReleaseGPUTransferBuffer(rend_ctx.gpu_dev, trans_buf);
 
-	log_trace("model uploaded");
+	log_trace("meshes uploaded");
 	return true;
 }
 
-SDL_GPUGraphicsPipeline *create_graphics_pipeline(SDL_GPUDevice *device,
-						  enum model_type type)
+// the shaders stay owned by the caller
+static SDL_GPUGraphicsPipeline *
+create_graphics_pipeline(SDL_GPUDevice *device, enum model_type type,
+			 SDL_GPUShader *vertex_shader,
+			 SDL_GPUShader *frag_shader,
+			 SDL_GPUTextureFormat color_format,
+			 SDL_GPUTextureFormat depth_format)
 {
+	bool terrain = type == MODEL_TERRAIN || type == MODEL_TERRAIN_DEPTH;
 	// for now MODEL_ACTOR and MODEL_MAP have same pipeline except shaders used, since
 	// pipeline doesn't show the cbuffer shader information that distinguishes them
 	SDL_GPUGraphicsPipeline *pipeline;
-	SDL_GPUShader *vertex_shader;
-	SDL_GPUShader *frag_shader;
-
-	switch (type) {
-	case MODEL_ACTOR: {
-		vertex_shader = load_shader(rend_ctx.gpu_dev, "position.vert",
-					    0, 1, 0, 0);
-		frag_shader =
-			load_shader(rend_ctx.gpu_dev, "color.frag", 0, 0, 0, 0);
-		break;
-	}
-	case MODEL_MAP: {
-		vertex_shader = load_shader(rend_ctx.gpu_dev,
-					    "position_color_shifted.vert", 0, 1,
-					    1, 0);
-		frag_shader = load_shader(rend_ctx.gpu_dev,
-					  "vert_input_color.frag", 0, 0, 0, 0);
-		break;
-	}
-	default:
-		break;
-	}
-
-	if (!vertex_shader || !frag_shader) {
-		log_err("unable to load shaders");
-		return NULL;
-	}
 
+	// slot 0: mesh vertices, slot 1: per instance data. instances come in
+	// as vertex attributes rather than a storage buffer indexed by
+	// SV_InstanceID, which ignores the draw commands' first_instance
 	SDL_GPUVertexAttribute vertex_attributes[] = {
 		{ .buffer_slot = 0,
 		  .format = SDL_GPU_VERTEXELEMENTFORMAT_FLOAT3,
 		  .location = 0,
-		  .offset = 0 }
+		  .offset = 0 },
+		{ .buffer_slot = 1,
+		  .format = SDL_GPU_VERTEXELEMENTFORMAT_SHORT2,
+		  .location = 1,
+		  .offset = offsetof(struct gpu_map_instance, x) },
+		{ .buffer_slot = 1,
+		  .format = SDL_GPU_VERTEXELEMENTFORMAT_UBYTE4,
+		  .location = 2,
+		  .offset = offsetof(struct gpu_map_instance, type) }
 	};
 	SDL_GPUVertexBufferDescription vertex_buffer_descriptions[] = {
 		{ .slot = 0,
 		  .input_rate = SDL_GPU_VERTEXINPUTRATE_VERTEX,
 		  .instance_step_rate = 0,
-		  .pitch = sizeof(vec3) }
+		  .pitch = sizeof(vec3) },
+		{ .slot = 1,
+		  .input_rate = SDL_GPU_VERTEXINPUTRATE_INSTANCE,
+		  .instance_step_rate = 0,
+		  .pitch = sizeof(struct gpu_map_instance) }
 	};
-	// TODO add more vertex buffers here, one for map, one for each actor etc?
 	SDL_GPUVertexInputState vertex_input_state = {
-		.num_vertex_buffers = 1,
+		.num_vertex_buffers = SDL_arraysize(vertex_buffer_descriptions),
 		.vertex_buffer_descriptions = vertex_buffer_descriptions,
-		.num_vertex_attributes = 1,
+		.num_vertex_attributes = SDL_arraysize(vertex_attributes),
 		.vertex_attributes = vertex_attributes,
 	};
+
+	// terrain vertices are in world space already, no instances
+	SDL_GPUVertexAttribute terrain_attributes[] = {
+		{ .buffer_slot = 0,
+		  .format = SDL_GPU_VERTEXELEMENTFORMAT_FLOAT3,
+		  .location = 0,
+		  .offset = offsetof(struct terrain_vertex, pos) },
+		{ .buffer_slot = 0,
+		  .format = SDL_GPU_VERTEXELEMENTFORMAT_UINT,
+		  .location = 1,
+		  .offset = offsetof(struct terrain_vertex, type) }
+	};
+	SDL_GPUVertexBufferDescription terrain_buffer_description = {
+		.slot = 0,
+		.input_rate = SDL_GPU_VERTEXINPUTRATE_VERTEX,
+		.instance_step_rate = 0,
+		.pitch = sizeof(struct terrain_vertex)
+	};
+	if (terrain) {
+		vertex_input_state = (SDL_GPUVertexInputState){
+			.num_vertex_buffers = 1,
+			.vertex_buffer_descriptions =
+				&terrain_buffer_description,
+			.num_vertex_attributes =
+				SDL_arraysize(terrain_attributes),
+			.vertex_attributes = terrain_attributes,
+		};
+	}
 	SDL_GPUColorTargetDescription color_target_descriptions[] = {
-		{ .format = SDL_GetGPUSwapchainTextureFormat(
-			  rend_ctx.gpu_dev, rend_ctx.rend_info->window) }
+		{ .format = color_format }
+	};
+	// the pre-pass keeps the color target so it fits the same render
+	// pass, but writes no color
+	if (type == MODEL_TERRAIN_DEPTH)
+		color_target_descriptions[0].blend_state =
+			(SDL_GPUColorTargetBlendState){
+				.enable_color_write_mask = true,
+				.color_write_mask = 0
+			};
+
+	// terrain passes less-or-equal so it still shows against its own
+	// pre-pass depth. it writes depth as well, which keeps it right if
+	// the pre-pass is unavailable
+	SDL_GPUDepthStencilState depth_stencil_state = {
+		.compare_op = terrain ? SDL_GPU_COMPAREOP_LESS_OR_EQUAL
+				      : SDL_GPU_COMPAREOP_LESS,
+		.enable_depth_test = true,
+		.enable_depth_write = true
 	};
 	SDL_GPURasterizerState rasterizer_state = {
 		.fill_mode = SDL_GPU_FILLMODE_LINE,
 		.cull_mode = SDL_GPU_CULLMODE_FRONT
 	};
+	// the mesher winds every face counter-clockwise seen from outside.
+	// terrain is solid, its depth pre-pass only saves shading when the
+	// faces are filled
+	if (terrain) {
+		rasterizer_state.fill_mode = SDL_GPU_FILLMODE_FILL;
+		rasterizer_state.cull_mode = SDL_GPU_CULLMODE_BACK;
+		rasterizer_state.front_face =
+			SDL_GPU_FRONTFACE_COUNTER_CLOCKWISE;
+	}
 	SDL_GPUGraphicsPipelineCreateInfo
 		pipeline_info = { .vertex_shader = vertex_shader,
 				  .fragment_shader = frag_shader,
@@ -542,51 +685,278 @@ SDL_GPUGraphicsPipeline *create_graphics_pipeline(SDL_GPUDevice *device,
 				  .primitive_type =
 					  SDL_GPU_PRIMITIVETYPE_TRIANGLELIST,
 				  .rasterizer_state = rasterizer_state,
+				  .depth_stencil_state = depth_stencil_state,
 				  .target_info = {
 					  .color_target_descriptions =
 						  color_target_descriptions,
 					  .num_color_targets = 1,
+					  .depth_stencil_format = depth_format,
+					  .has_depth_stencil_target = true,
 				  } };
 
 	pipeline = SDL_CreateGPUGraphicsPipeline(device, &pipeline_info);
-
-	SDL_ReleaseGPUShader(rend_ctx.gpu_dev, vertex_shader);
-	SDL_ReleaseGPUShader(rend_ctx.gpu_dev, frag_shader);
+	if (!pipeline)
+		log_err("SDL_CreateGPUGraphicsPipeline failed: %s",
+			SDL_GetError());
 
 	return pipeline;
 }
 
-struct gpu_map_pos_info {
-	vec3 pos_xyz;
-	uint32_t map_type;
-	vec4 color;
+static bool create_terrain_buffers(struct render_context *ctx)
+{
+	ctx->terrain_vertex_buf = SDL_CreateGPUBuffer(
+		ctx->gpu_dev,
+		&(SDL_GPUBufferCreateInfo){
+			.usage = SDL_GPU_BUFFERUSAGE_VERTEX,
+			.size = MAP_LEVEL_CHUNKS * TERRAIN_CHUNK_MAX_VERTICES *
+				sizeof(struct terrain_vertex) });
+	ctx->terrain_index_buf = SDL_CreateGPUBuffer(
+		ctx->gpu_dev,
+		&(SDL_GPUBufferCreateInfo){
+			.usage = SDL_GPU_BUFFERUSAGE_INDEX,
+			.size = MAP_LEVEL_CHUNKS * TERRAIN_CHUNK_MAX_INDICES *
+				sizeof(Uint16) });
+	ctx->terrain_draw_buf = SDL_CreateGPUBuffer(
+		ctx->gpu_dev,
+		&(SDL_GPUBufferCreateInfo){
+			.usage = SDL_GPU_BUFFERUSAGE_INDIRECT,
+			.size = MAP_LEVEL_CHUNKS *
+				sizeof(SDL_GPUIndexedIndirectDrawCommand) });
+	if (!ctx->terrain_vertex_buf || !ctx->terrain_index_buf ||
+	    !ctx->terrain_draw_buf) {
+		log_err("SDL_CreateGPUBuffer failed: %s", SDL_GetError());
+		return false;
+	}
+	return true;
+}
+
+// startup work that doesn't depend on each other runs as jobs spread over
+// worker threads, each job writes only its own result
+struct init_state {
+	SDL_GPUDevice *device;
+	SDL_GPUTextureFormat color_format;
+	SDL_GPUTextureFormat depth_format;
+	SDL_GPUShader *shaders[SHADER_COUNT];
+	SDL_GPUGraphicsPipeline *pipelines[MODEL_COUNT];
+	SDL_GPUComputePipeline *cull_pipeline;
+	struct model *models[MESH_COUNT];
 };
 
+struct init_job {
+	void (*fn)(struct init_state *state, int arg);
+	int arg;
+};
+
+struct init_jobs {
+	struct init_state *state;
+	const struct init_job *jobs;
+	int count;
+	SDL_AtomicInt next;
+};
+
+static void load_shader_job(struct init_state *state, int id)
+{
+	const struct shader_source *src = &shader_sources[id];
+	state->shaders[id] = load_shader(state->device, src->file, 0,
+					 src->num_uniform_buffers,
+					 src->num_storage_buffers, 0);
+}
+
+static void load_mesh_job(struct init_state *state, int id)
+{
+	state->models[id] = load_obj(mesh_sources[id].file);
+}
+
+static void create_pipeline_job(struct init_state *state, int type)
+{
+	const struct pipeline_source *src = &pipeline_sources[type];
+	SDL_GPUShader *vert = state->shaders[src->vert];
+	SDL_GPUShader *frag = state->shaders[src->frag];
+	if (!vert || !frag)
+		return;
+	state->pipelines[type] =
+		create_graphics_pipeline(state->device, type, vert, frag,
+					 state->color_format,
+					 state->depth_format);
+}
+
+static void create_cull_pipeline_job(struct init_state *state, int arg)
+{
+	state->cull_pipeline = create_cull_pipeline(state->device);
+}
+
+static int init_worker(void *data)
+{
+	struct init_jobs *jobs = data;
+	int i;
+	while ((i = SDL_AddAtomicInt(&jobs->next, 1)) < jobs->count)
+		jobs->jobs[i].fn(jobs->state, jobs->jobs[i].arg);
+	return 0;
+}
+
+// run the jobs and wait for all of them, the calling thread works along
+static void run_init_jobs(struct init_state *state,
+			  const struct init_job *jobs, int count)
+{
+	struct init_jobs pool = { .state = state, .jobs = jobs, .count = count };
+	SDL_SetAtomicInt(&pool.next, 0);
+
+	int num_threads = SDL_min(SDL_min(count, SDL_GetNumLogicalCPUCores()),
+				  RENDER_INIT_THREADS);
+	SDL_Thread *threads[RENDER_INIT_THREADS];
+	int num_started = 0;
+	for (int i = 1; i < num_threads; ++i) {
+		SDL_Thread *thread =
+			SDL_CreateThread(init_worker, "render_init", &pool);
+		// whatever doesn't start is picked up by the others
+		if (thread)
+			threads[num_started++] = thread;
+	}
+	init_worker(&pool);
+	for (int i = 0; i < num_started; ++i)
+		SDL_WaitThread(threads[i], NULL);
+}
+
+static bool depth_prepass_from_env(void)
+{
+	char *prepass_env = getenv(depth_prepass_env_key);
+	if (!prepass_env)
+		return true;
+	if (strcmp(prepass_env, "0") == 0) {
+		log_info("terrain depth pre-pass off");
+		return false;
+	}
+	if (strcmp(prepass_env, "1") != 0)
+		log_warn("invalid %s %s, using 1", depth_prepass_env_key,
+			 prepass_env);
+	return true;
+}
+
+// load every shader and mesh, then build the pipelines from the shaders, all
+// in parallel. shaders are released once the pipelines hold them
+static bool create_pipelines(struct render_context *ctx,
+			     struct init_state *init)
+{
+	*init = (struct init_state){
+		.device = ctx->gpu_dev,
+		.color_format = SDL_GetGPUSwapchainTextureFormat(
+			ctx->gpu_dev, ctx->rend_info->window),
+		.depth_format = ctx->depth_format,
+	};
+
+	struct init_job jobs[SHADER_COUNT + MESH_COUNT + MODEL_COUNT + 1];
+	int num_jobs = 0;
+	for (int i = 0; i < SHADER_COUNT; ++i)
+		jobs[num_jobs++] = (struct init_job){ load_shader_job, i };
+	for (int i = 0; i < MESH_COUNT; ++i)
+		jobs[num_jobs++] = (struct init_job){ load_mesh_job, i };
+	int phase = startup_begin("shaders and meshes");
+	run_init_jobs(init, jobs, num_jobs);
+	startup_end(phase);
+
+	// a terrain path without its shader drops to the cull pass right away,
+	// so that pipeline builds along with the others
+	bool terrain = ctx->map_path == MAP_PATH_TERRAIN;
+	if (terrain && !init->shaders[SHADER_TERRAIN_VERT]) {
+		log_info("terrain shader unavailable");
+		terrain = false;
+		ctx->map_path = MAP_PATH_GPU_CULL;
+	}
+
+	bool build[MODEL_COUNT];
+	for (int i = 0; i < MODEL_COUNT; ++i)
+		build[i] = pipeline_sources[i].name != NULL;
+	build[MODEL_TERRAIN] = build[MODEL_TERRAIN] && terrain;
+	build[MODEL_TERRAIN_DEPTH] = build[MODEL_TERRAIN_DEPTH] && terrain &&
+				     depth_prepass_from_env();
+
+	num_jobs = 0;
+	for (int i = 0; i < MODEL_COUNT; ++i) {
+		if (build[i])
+			jobs[num_jobs++] =
+				(struct init_job){ create_pipeline_job, i };
+	}
+	if (ctx->map_path == MAP_PATH_GPU_CULL)
+		jobs[num_jobs++] = (struct init_job){ create_cull_pipeline_job, 0 };
+	phase = startup_begin("pipelines");
+	run_init_jobs(init, jobs, num_jobs);
+	startup_end(phase);
+
+	for (int i = 0; i < SHADER_COUNT; ++i) {
+		if (init->shaders[i])
+			SDL_ReleaseGPUShader(ctx->gpu_dev, init->shaders[i]);
+	}
+
+	bool ok = true;
+	for (int i = 0; i < MODEL_COUNT; ++i) {
+		const struct pipeline_source *src = &pipeline_sources[i];
+		if (build[i] && !init->pipelines[i]) {
+			if (src->required) {
+				log_err("unable to create %s pipeline",
+					src->name);
+				ok = false;
+			} else {
+				log_info("%s pipeline unavailable", src->name);
+			}
+		}
+	}
+	ctx->pipeline = init->pipelines[MODEL_MAP];
+	ctx->terrain_pipeline = init->pipelines[MODEL_TERRAIN];
+	ctx->terrain_depth_pipeline = init->pipelines[MODEL_TERRAIN_DEPTH];
+	if (ctx->terrain_depth_pipeline && !ctx->terrain_pipeline) {
+		SDL_ReleaseGPUGraphicsPipeline(ctx->gpu_dev,
+					       ctx->terrain_depth_pipeline);
+		ctx->terrain_depth_pipeline = NULL;
+	}
+	ctx->cull_pipeline = init->cull_pipeline;
+
+	// a terrain pipeline that failed to build leaves no cull pass to fall
+	// back on, the cpu kernels always work
+	if (ctx->map_path == MAP_PATH_TERRAIN && !ctx->terrain_pipeline)
+		ctx->map_path = MAP_PATH_CPU_CULL;
+	if (ctx->map_path == MAP_PATH_GPU_CULL && !ctx->cull_pipeline)
+		ctx->map_path = MAP_PATH_CPU_CULL;
+	return ok;
+}
+
+static enum map_path map_path_from_env(void)
+{
+	char *path_env = getenv(map_path_env_key);
+	if (!path_env)
+		return MAP_PATH_TERRAIN;
+
+	for (int i = 0; i < MAP_PATH_COUNT; ++i) {
+		if (strcmp(path_env, map_path_names[i]) == 0)
+			return (enum map_path)i;
+	}
+	log_warn("unknown %s %s, using TERRAIN", map_path_env_key, path_env);
+	return MAP_PATH_TERRAIN;
+}
+
 // TODO investigate this, would be slightly more data bandwitdh efficient without and extra 32-bit padding
 // typedef float gpu_map_data
 // 	[7]; // xyzrgba NOTE maybe above bad due to misalignment of struct?
 
 bool render_init()
 {
-	// set up resource+shader dirs
+	// shaders/ and resources/ sit next to the binary
 	log_trace("using base dir: %s", SDL_GetBasePath());
-	snprintf(resource_path, PATH_MAX, "%s%s", SDL_GetBasePath(),
-		 "resources");
-	snprintf(shader_path, PATH_MAX, "%s%s", SDL_GetBasePath(), "shaders");
-	log_trace("using resource dir: %s", resource_path);
-	log_trace("using shader dir: %s", shader_path);
+	if (!asset_init(SDL_GetBasePath()))
+		return false;
 
 	rend_ctx = (struct render_context) { 
 		.rend_info = &rend_info, 
 		0 
 	};
-	// clear map data:
-	for (int i = 0; i < MAX_MAP_VISIBLE; ++i) {
-		rend_ctx.last_frame_map[i].type = MTYPE_NONE;
+	// clear map data, instances are added as map cells turn up dirty:
+	for (int i = 0; i < MAP_CELLS; ++i) {
+		rend_ctx.cell_instance[i] = -1;
 	}
-	rend_ctx.last_frame_changed = true; // allow initial map render
+	rend_ctx.dirty_instance_lo = MAP_CELLS;
+	rend_ctx.dirty_instance_hi = -1;
 
 	// create window:
+	int phase = startup_begin("window");
 	// 200% for retina TODO: is this needed for w, h in CreateWindow,
 	// or does it take into account already?
 	float display_scale =
@@ -610,8 +980,10 @@ bool render_init()
 			       &rend_ctx.rend_info->win_h)) {
 		log_err("SDL_GetWindowSize error: %s", SDL_GetError());
 	}
+	startup_end(phase);
 
 	// SDL gpu setup:
+	phase = startup_begin("gpu device");
 	rend_ctx.gpu_dev = SDL_CreateGPUDevice(
 		SDL_GPU_SHADERFORMAT_MSL | SDL_GPU_SHADERFORMAT_SPIRV |
 			SDL_GPU_SHADERFORMAT_DXIL,
@@ -637,51 +1009,75 @@ bool render_init()
 			SDL_GetError());
 		return false;
 	}
+	startup_end(phase);
+
+	// most precise depth format the device has, only 16 bit is guaranteed
+	// (no 24 bit on apple silicon)
+	static const SDL_GPUTextureFormat depth_formats[] = {
+		SDL_GPU_TEXTUREFORMAT_D32_FLOAT,
+		SDL_GPU_TEXTUREFORMAT_D24_UNORM,
+	};
+	rend_ctx.depth_format = SDL_GPU_TEXTUREFORMAT_D16_UNORM;
+	for (size_t i = 0; i < SDL_arraysize(depth_formats); ++i) {
+		if (SDL_GPUTextureSupportsFormat(
+			    rend_ctx.gpu_dev, depth_formats[i],
+			    SDL_GPU_TEXTURETYPE_2D,
+			    SDL_GPU_TEXTUREUSAGE_DEPTH_STENCIL_TARGET)) {
+			rend_ctx.depth_format = depth_formats[i];
+			break;
+		}
+	}
 
 	// load models and shaders etc etc
-	rend_ctx.pipeline =
-		create_graphics_pipeline(rend_ctx.gpu_dev, MODEL_MAP);
-	if (!rend_ctx.pipeline) {
-		log_err("pipeline creation error: %s", SDL_GetError());
+	rend_ctx.map_path = map_path_from_env();
+	enum map_path requested = rend_ctx.map_path;
+	struct init_state init;
+	if (!create_pipelines(&rend_ctx, &init)) {
+		for (int i = 0; i < MESH_COUNT; ++i)
+			obj_free(init.models[i]);
 		return false;
 	}
 
 	// load vertex/index data:
-	// struct model *model = load_obj("monkey.obj");
-	struct model *model = load_obj("cube.obj");
-	model->type = MODEL_MAP;
-	// track in render context as well
-	rend_ctx.tile_cube = model;
+	phase = startup_begin("mesh upload");
+	if (!upload_meshes(&rend_ctx, init.models))
+		return false;
+	startup_end(phase);
+
+	if (rend_ctx.map_path != requested)
+		log_info("%s map path unavailable", map_path_names[requested]);
+	log_info("map path %s", map_path_names[rend_ctx.map_path]);
+	if (rend_ctx.map_path == MAP_PATH_TERRAIN) {
+		if (!create_terrain_buffers(&rend_ctx))
+			return false;
+	} else if (rend_ctx.map_path == MAP_PATH_GPU_CULL) {
+		rend_ctx.tile_buf = SDL_CreateGPUBuffer(
+			rend_ctx.gpu_dev,
+			&(SDL_GPUBufferCreateInfo){
+				.usage = SDL_GPU_BUFFERUSAGE_COMPUTE_STORAGE_READ,
+				.size = MAP_CELLS *
+					sizeof(struct gpu_map_instance) });
+		if (!rend_ctx.tile_buf) {
+			log_err("SDL_CreateGPUBuffer failed: %s",
+				SDL_GetError());
+			return false;
+		}
+	}
 
 	// set up gpu buffer for map data:
-	rend_ctx.map_data_pos_trans_buf = SDL_CreateGPUTransferBuffer(
-		rend_ctx.gpu_dev,
-		&(SDL_GPUTransferBufferCreateInfo){
-			.usage = SDL_GPU_TRANSFERBUFFERUSAGE_UPLOAD,
-			.size = (Uint32)(MAX_MAP_VISIBLE *
-					 sizeof(struct gpu_map_pos_info)) });
+	for (int i = 0; i < RENDER_FRAMES_IN_FLIGHT; ++i) {
+		rend_ctx.frames[i].trans_buf = SDL_CreateGPUTransferBuffer(
+			rend_ctx.gpu_dev,
+			&(SDL_GPUTransferBufferCreateInfo){
+				.usage = SDL_GPU_TRANSFERBUFFERUSAGE_UPLOAD,
+				.size = (Uint32)FRAME_UPLOAD_SIZE });
+		if (!rend_ctx.frames[i].trans_buf) {
+			log_err("SDL_CreateGPUTransferBuffer failed: %s",
+				SDL_GetError());
+			return false;
+		}
+	}
 
-	rend_ctx.map_data_buf = SDL_CreateGPUBuffer(
-		rend_ctx.gpu_dev,
-		&(SDL_GPUBufferCreateInfo){
-			.usage = SDL_GPU_BUFFERUSAGE_GRAPHICS_STORAGE_READ,
-			.size = (Uint32)(MAX_MAP_VISIBLE *
-					 sizeof(struct gpu_map_pos_info)) });
-
-	// struct vec3 square_v[4] = {
-	// 	{ -1, -1, 0 }, { 1, -1, 0 }, { 1, 1, 0 }, { -1, 1, 0 }
-	// };
-	// struct face square_f[2] = { { { 0, 1, 2 }, { 0, 0, 0 } },
-	// 			    { { 0, 2, 3 }, { 0, 0, 0 } } };
-	// struct model testmodel = { .vertices = square_v,
-	// 			   .uvs = NULL,
-	// 			   .faces = square_f,
-	// 			   .vertex_count = 4,
-	// 			   .uv_count = 0,
-	// 			   .face_count = 2 };
-	// print_model(&testmodel);
-	upload_model(&rend_ctx, model);
-	// free(model);
 	return true;
 }
 
@@ -707,107 +1103,530 @@ static void camera_to_viewproj(const struct camera *cam, mat4 dest)
 	glm_mat4_mul(projection, lookat, dest);
 }
 
-static bool push_gpu_map_data(struct render_context *ctx,
-			      SDL_GPUCommandBuffer *cmd_buf,
-			      const struct map_pos_info *visible_map)
-{
-	// TODO: need to skip if data hasn't changed since last 60fps frame, check if each map tile type is same
-	// TODO: !!! will need to store e.g. copy to creature pointer to distinguish identical monsters
-	// exit only if all tiles match, if any are different from before than it's new
-	// {
-	// 	int i;
-	// 	for (i = 0; i < MAX_MAP_VISIBLE; ++i) {
-	// 		// log_trace("visible_map[i].type : %d", visible_map[i].type); THIS IS CORRECTLY FLOOR
-	// 		if (ctx->last_frame_map[i].type != visible_map[i].type)
-	// 			break;
-	// 		ctx->last_frame_map[i].type = visible_map[i].type;
-	// 	}
-	// 	if (i == MAX_MAP_VISIBLE || visible_map[i].type == MTYPE_NONE) {
-	// 		return true; // if visible_map[idx] == MTYPE_NONE it means we exhausted the list, i.e. every element matches
-	// 	}
-	// }
-	// NOTE: simpler: just set bool frame_map_changed false here. when map is updated set it to true elsewhere, causing failure
-	if (!ctx->last_frame_changed)
-		return true;
+static void mark_instance_dirty(struct render_context *ctx, int slot)
+{
+	ctx->dirty_instance_bits[slot / 64] |= (uint64_t)1 << (slot % 64);
+	if (slot < ctx->dirty_instance_lo)
+		ctx->dirty_instance_lo = slot;
+	if (slot > ctx->dirty_instance_hi)
+		ctx->dirty_instance_hi = slot;
+}
 
-	// TODO pass in *visible_map size?
-	// translate game-native map_pos_info to gpu-native gpu_map_pos_info
+static bool instance_dirty(const struct render_context *ctx, int slot)
+{
+	return ctx->dirty_instance_bits[slot / 64] & ((uint64_t)1 << (slot % 64));
+}
 
-	struct gpu_map_pos_info *map_trans = SDL_MapGPUTransferBuffer(
-		ctx->gpu_dev, ctx->map_data_pos_trans_buf, true);
+static void clear_dirty_instances(struct render_context *ctx)
+{
+	if (ctx->dirty_instance_lo <= ctx->dirty_instance_hi)
+		memset(&ctx->dirty_instance_bits[ctx->dirty_instance_lo / 64],
+		       0,
+		       (ctx->dirty_instance_hi / 64 -
+			ctx->dirty_instance_lo / 64 + 1) *
+			       sizeof(uint64_t));
+	ctx->dirty_instance_lo = MAP_CELLS;
+	ctx->dirty_instance_hi = -1;
+}
 
-	int num_tiles_visible = 0;
-	for (int i = 0; i < MAX_MAP_VISIBLE; ++i) {
-		// set position, cube extends +-1 xyz i.e. width = 2.0
-		// NOTE need to flip axis
-		map_trans[i].pos_xyz[0] =
-			((float)visible_map[i].coord.y * -2.0f) + 0.5f;
-		map_trans[i].pos_xyz[1] =
-			((float)visible_map[i].coord.x * 2.0f) + 0.5f;
+// bring the instance for one map cell in line with the map model
+static void update_map_instance(struct render_context *ctx,
+				const struct map_model *map, int cell)
+{
+	enum map_type type = map_get_index(map, cell);
+	int slot = ctx->cell_instance[cell];
+
+	if (type == MTYPE_NONE) {
+		if (slot < 0)
+			return;
+		// move the last instance into the hole to stay contiguous
+		int last = --ctx->num_map_instances;
+		if (slot != last) {
+			int moved_cell = ctx->instance_cell[last];
+			ctx->instance_cell[slot] = moved_cell;
+			ctx->instance_x[slot] = ctx->instance_x[last];
+			ctx->instance_y[slot] = ctx->instance_y[last];
+			ctx->instance_type[slot] = ctx->instance_type[last];
+			ctx->cell_instance[moved_cell] = (int16_t)slot;
+			mark_instance_dirty(ctx, slot);
+		}
+		ctx->cell_instance[cell] = -1;
+		return;
+	}
 
-		map_trans[i].map_type = (uint32_t)visible_map[i].type;
+	if (slot < 0) {
+		slot = ctx->num_map_instances++;
+		ctx->cell_instance[cell] = (int16_t)slot;
+		ctx->instance_cell[slot] = (uint16_t)cell;
+		ctx->instance_x[slot] = (int16_t)map_index_x(cell);
+		ctx->instance_y[slot] = (int16_t)map_index_y(cell);
+	}
+	ctx->instance_type[slot] = (uint8_t)type;
+	mark_instance_dirty(ctx, slot);
+}
 
-		// set map tile color based on its type
-		glm_vec4_copy(map_type_color[visible_map[i].type],
-			      map_trans[i].color);
+// pack the dirty instances into the transfer buffer as runs, returns the
+// number of runs written to ranges
+static int write_dirty_instances(const struct render_context *ctx,
+				 struct gpu_map_instance *out,
+				 struct instance_range *ranges)
+{
+	int num_ranges = 0;
+	int end = SDL_min(ctx->dirty_instance_hi + 1, ctx->num_map_instances);
+	for (int i = ctx->dirty_instance_lo; i < end; ++i) {
+		if (!instance_dirty(ctx, i))
+			continue;
+		struct instance_range *last =
+			num_ranges ? &ranges[num_ranges - 1] : NULL;
+		if (last && i - (int)(last->first + last->count) <= MAP_UPLOAD_GAP) {
+			// extend the previous run over the gap
+			while ((int)(last->first + last->count) <= i) {
+				int slot = last->first + last->count++;
+				*out++ = pack_map_instance(
+					ctx->instance_x[slot],
+					ctx->instance_y[slot],
+					ctx->instance_type[slot]);
+			}
+			continue;
+		}
+		ranges[num_ranges++] = (struct instance_range){ i, 1 };
+		*out++ = pack_map_instance(ctx->instance_x[i],
+					   ctx->instance_y[i],
+					   ctx->instance_type[i]);
+	}
+	return num_ranges;
+}
 
-		if (visible_map[i].type != MTYPE_NONE)
-			++num_tiles_visible;
+// this frame's transfer buffer, waiting for the gpu to finish the frame that
+// used it last if it hasn't yet
+static SDL_GPUTransferBuffer *acquire_frame_upload(struct render_context *ctx)
+{
+	struct frame_upload *frame = &ctx->frames[ctx->frame_index];
+	if (frame->fence) {
+		if (!SDL_QueryGPUFence(ctx->gpu_dev, frame->fence)) {
+			++ctx->rend_info->upload_waits;
+			log_trace("waiting on gpu for upload buffer %d",
+				  ctx->frame_index);
+			SDL_WaitForGPUFences(ctx->gpu_dev, true, &frame->fence,
+					     1);
+		}
+		SDL_ReleaseGPUFence(ctx->gpu_dev, frame->fence);
+		frame->fence = NULL;
 	}
-	// log_trace("num_tiles_visible: %d", num_tiles_visible);
+	return frame->trans_buf;
+}
+
+// hand the frame's command buffer to the gpu and move on to the next upload
+// buffer
+static void submit_frame(struct render_context *ctx,
+			 SDL_GPUCommandBuffer *cmd_buf)
+{
+	struct frame_upload *frame = &ctx->frames[ctx->frame_index];
+	if (frame->fence)
+		SDL_ReleaseGPUFence(ctx->gpu_dev, frame->fence);
+	frame->fence = SDL_SubmitGPUCommandBufferAndAcquireFence(cmd_buf);
+	if (!frame->fence)
+		log_err("SDL_SubmitGPUCommandBufferAndAcquireFence failed: %s",
+			SDL_GetError());
+	ctx->frame_index = (ctx->frame_index + 1) % RENDER_FRAMES_IN_FLIGHT;
+}
 
-	SDL_UnmapGPUTransferBuffer(ctx->gpu_dev, ctx->map_data_pos_trans_buf);
+// cpu culling when there is no cull pass: the visible tiles are culled again
+// whenever the view or the tiles change and uploaded compacted into the tile
+// instance range
+static bool push_cpu_culled_tiles(struct render_context *ctx,
+				  SDL_GPUCommandBuffer *cmd_buf, mat4 viewproj)
+{
+	bool view_changed =
+		memcmp(viewproj, ctx->culled_viewproj, sizeof(mat4)) != 0;
+	bool tiles_changed = ctx->dirty_instance_lo <= ctx->dirty_instance_hi;
+	clear_dirty_instances(ctx);
+	if (!view_changed && !tiles_changed)
+		return true;
+	memcpy(ctx->culled_viewproj, viewproj, sizeof(mat4));
+
+	struct frustum frustum;
+	frustum_from_viewproj(viewproj, &frustum);
+	int num_visible = cull_tiles(&frustum, ctx->instance_x,
+				     ctx->instance_y, ctx->instance_type,
+				     ctx->num_map_instances, ctx->visible);
+
+	SDL_GPUTransferBuffer *trans_buf = acquire_frame_upload(ctx);
+	Uint8 *trans = SDL_MapGPUTransferBuffer(ctx->gpu_dev, trans_buf, false);
+	if (!trans) {
+		log_err("SDL_MapGPUTransferBuffer failed: %s", SDL_GetError());
+		return false;
+	}
+	struct gpu_map_instance *out =
+		(struct gpu_map_instance *)(trans + FRAME_UPLOAD_INSTANCES_OFFSET);
+	for (int i = 0; i < num_visible; ++i) {
+		uint32_t slot = ctx->visible[i];
+		out[i] = pack_map_instance(ctx->instance_x[slot],
+					   ctx->instance_y[slot],
+					   ctx->instance_type[slot]);
+	}
+	struct mesh *tiles = &ctx->meshes[MESH_TILE];
+	tiles->num_instances = (Uint32)num_visible;
+	write_draw_commands(ctx, (SDL_GPUIndexedIndirectDrawCommand *)trans);
+	SDL_UnmapGPUTransferBuffer(ctx->gpu_dev, trans_buf);
+	log_trace("cpu culled %d of %d tiles", num_visible,
+		  ctx->num_map_instances);
 
-	// read in list of map data, push to gpu buffer as coords
 	SDL_GPUCopyPass *copy_pass = SDL_BeginGPUCopyPass(cmd_buf);
-	SDL_UploadToGPUBuffer(copy_pass,
-			      &(SDL_GPUTransferBufferLocation){
-				      .transfer_buffer =
-					      ctx->map_data_pos_trans_buf,
-				      .offset = 0 },
-			      &(SDL_GPUBufferRegion){
-				      .buffer = ctx->map_data_buf,
-				      .offset = 0,
-				      .size = MAX_MAP_VISIBLE *
-					      sizeof(struct gpu_map_pos_info) },
-			      true);
+	if (num_visible > 0) {
+		SDL_UploadToGPUBuffer(
+			copy_pass,
+			&(SDL_GPUTransferBufferLocation){
+				.transfer_buffer = trans_buf,
+				.offset = FRAME_UPLOAD_INSTANCES_OFFSET },
+			&(SDL_GPUBufferRegion){
+				.buffer = ctx->instance_buf,
+				.offset = tiles->first_instance *
+					  sizeof(struct gpu_map_instance),
+				.size = num_visible *
+					sizeof(struct gpu_map_instance) },
+			false);
+	}
+	SDL_UploadToGPUBuffer(
+		copy_pass,
+		&(SDL_GPUTransferBufferLocation){ .transfer_buffer = trans_buf,
+						  .offset = 0 },
+		&(SDL_GPUBufferRegion){
+			.buffer = ctx->draw_buf,
+			.offset = 0,
+			.size = sizeof(SDL_GPUIndexedIndirectDrawCommand) *
+				MESH_COUNT },
+		true);
+	SDL_EndGPUCopyPass(copy_pass);
+	return true;
+}
+
+static bool push_gpu_map_data(struct render_context *ctx,
+			      SDL_GPUCommandBuffer *cmd_buf,
+			      const struct map_model *map, mat4 viewproj)
+{
+	// only cells the server changed since last frame need new instances
+	for (int i = 0; i < map->dirty_count; ++i)
+		update_map_instance(ctx, map, map->dirty[i]);
+
+	if (!ctx->cull_pipeline)
+		return push_cpu_culled_tiles(ctx, cmd_buf, viewproj);
+
+	// gpu traffic scales with the changes: only the dirty instance runs
+	// are written and uploaded to the cull pass input. the draw commands
+	// go every frame, the cull pass counts the visible tiles into them.
+	// everything goes in one copy pass
+	struct instance_range *ranges = ctx->upload_ranges;
+	int num_ranges = 0;
+	bool instances_changed = ctx->dirty_instance_lo < ctx->num_map_instances;
+	struct mesh *tiles = &ctx->meshes[MESH_TILE];
+
+	SDL_GPUTransferBuffer *trans_buf = acquire_frame_upload(ctx);
+	Uint8 *trans = SDL_MapGPUTransferBuffer(ctx->gpu_dev, trans_buf, false);
+	if (!trans) {
+		log_err("SDL_MapGPUTransferBuffer failed: %s", SDL_GetError());
+		return false;
+	}
+	if (instances_changed)
+		num_ranges = write_dirty_instances(
+			ctx,
+			(struct gpu_map_instance *)(trans +
+						    FRAME_UPLOAD_INSTANCES_OFFSET),
+			ranges);
+	clear_dirty_instances(ctx);
+
+	tiles->num_instances = (Uint32)ctx->num_map_instances;
+	write_draw_commands(ctx, (SDL_GPUIndexedIndirectDrawCommand *)trans);
+	SDL_UnmapGPUTransferBuffer(ctx->gpu_dev, trans_buf);
+
+	SDL_GPUCopyPass *copy_pass = SDL_BeginGPUCopyPass(cmd_buf);
+	Uint32 src_offset = FRAME_UPLOAD_INSTANCES_OFFSET;
+	for (int i = 0; i < num_ranges; ++i) {
+		const Uint32 size =
+			ranges[i].count * sizeof(struct gpu_map_instance);
+		// no cycling, the rest of the buffer must stay as it was
+		SDL_UploadToGPUBuffer(
+			copy_pass,
+			&(SDL_GPUTransferBufferLocation){
+				.transfer_buffer = trans_buf,
+				.offset = src_offset },
+			&(SDL_GPUBufferRegion){
+				.buffer = ctx->tile_buf,
+				.offset = ranges[i].first *
+					  sizeof(struct gpu_map_instance),
+				.size = size },
+			false);
+		src_offset += size;
+	}
+	SDL_UploadToGPUBuffer(
+		copy_pass,
+		&(SDL_GPUTransferBufferLocation){ .transfer_buffer = trans_buf,
+						  .offset = 0 },
+		&(SDL_GPUBufferRegion){
+			.buffer = ctx->draw_buf,
+			.offset = 0,
+			.size = sizeof(SDL_GPUIndexedIndirectDrawCommand) *
+				MESH_COUNT },
+		true);
 	SDL_EndGPUCopyPass(copy_pass);
+	log_trace("uploaded %d instance ranges, %u bytes", num_ranges,
+		  src_offset - FRAME_UPLOAD_INSTANCES_OFFSET);
 
-	// do same for draw_buf setting the number of visible tiles
-
-	SDL_GPUIndexedIndirectDrawCommand *draw_trans =
-		(SDL_GPUIndexedIndirectDrawCommand *)SDL_MapGPUTransferBuffer(
-			ctx->gpu_dev, ctx->map_data_draw_trans_buf, true);
-	// just update, don't set whole thing:
-	draw_trans[0] = (SDL_GPUIndexedIndirectDrawCommand){
-		.num_indices = (Uint32)(3 * ctx->tile_cube->face_count),
-		// set this:
-		.num_instances = num_tiles_visible,
-		.first_index = 0,
-		.vertex_offset = 0,
-		.first_instance = 0
+	return true;
+}
+
+// compact the tiles in the view frustum into the tile instance range
+static void cull_map_tiles(struct render_context *ctx,
+			   SDL_GPUCommandBuffer *cmd_buf, mat4 viewproj)
+{
+	if (!ctx->cull_pipeline || ctx->num_map_instances == 0)
+		return;
+
+	const struct mesh *tiles = &ctx->meshes[MESH_TILE];
+	struct frustum frustum;
+	frustum_from_viewproj(viewproj, &frustum);
+	struct cull_uniforms uniforms = {
+		.tile_count = (Uint32)ctx->num_map_instances,
+		.first_instance = tiles->first_instance,
+		.draw_count_offset =
+			MESH_TILE * sizeof(SDL_GPUIndexedIndirectDrawCommand) +
+			offsetof(SDL_GPUIndexedIndirectDrawCommand,
+				 num_instances),
 	};
-	SDL_UnmapGPUTransferBuffer(ctx->gpu_dev, ctx->map_data_draw_trans_buf);
-	log_trace("draw_trans[0].num_indices, num_instances : %d, %d",
-		  draw_trans[0].num_indices, draw_trans[0].num_instances);
+	memcpy(uniforms.planes, frustum.planes, sizeof(uniforms.planes));
+
+	// no cycling, the other meshes' instances and draw commands stay
+	SDL_GPUComputePass *pass = SDL_BeginGPUComputePass(
+		cmd_buf, NULL, 0,
+		(SDL_GPUStorageBufferReadWriteBinding[]){
+			{ .buffer = ctx->instance_buf, .cycle = false },
+			{ .buffer = ctx->draw_buf, .cycle = false } },
+		2);
+	SDL_BindGPUComputePipeline(pass, ctx->cull_pipeline);
+	SDL_BindGPUComputeStorageBuffers(pass, 0, &ctx->tile_buf, 1);
+	SDL_PushGPUComputeUniformData(cmd_buf, 0, &uniforms, sizeof(uniforms));
+	SDL_DispatchGPUCompute(
+		pass, (uniforms.tile_count + CULL_THREADS - 1) / CULL_THREADS,
+		1, 1);
+	SDL_EndGPUComputePass(pass);
+}
+
+// a changed cell needs its chunk remeshed, and the chunk next to it if it
+// lies on the border since the neighbour's faces towards it may change
+static void mark_terrain_dirty(struct render_context *ctx,
+			       const struct map_model *map)
+{
+	const int edge = MAP_CHUNK_DIM - 1;
+	for (int i = 0; i < map->dirty_count; ++i) {
+		int x = map_index_x(map->dirty[i]);
+		int y = map_index_y(map->dirty[i]);
+		int cx = x >> MAP_CHUNK_SHIFT, cy = y >> MAP_CHUNK_SHIFT;
+		ctx->terrain_dirty[cy * MAP_CHUNKS_X + cx] = true;
+		if ((x & edge) == 0 && cx > 0)
+			ctx->terrain_dirty[cy * MAP_CHUNKS_X + cx - 1] = true;
+		if ((x & edge) == edge && cx + 1 < MAP_CHUNKS_X)
+			ctx->terrain_dirty[cy * MAP_CHUNKS_X + cx + 1] = true;
+		if ((y & edge) == 0 && cy > 0)
+			ctx->terrain_dirty[(cy - 1) * MAP_CHUNKS_X + cx] = true;
+		if ((y & edge) == edge && cy + 1 < MAP_CHUNKS_Y)
+			ctx->terrain_dirty[(cy + 1) * MAP_CHUNKS_X + cx] = true;
+	}
+}
 
-	copy_pass = SDL_BeginGPUCopyPass(cmd_buf);
+// remesh the dirty chunks straight into the transfer buffer and upload them
+// to their slots. the chunks are culled against the view whenever it or the
+// terrain changes, the draw commands leave culled and empty chunks out
+static bool push_terrain(struct render_context *ctx,
+			 SDL_GPUCommandBuffer *cmd_buf,
+			 const struct map_model *map, mat4 viewproj)
+{
+	mark_terrain_dirty(ctx, map);
+
+	int remesh[TERRAIN_UPLOAD_CHUNKS];
+	int num_remesh = 0;
+	for (int i = 0; i < MAP_LEVEL_CHUNKS; ++i) {
+		if (ctx->terrain_dirty[i] && num_remesh < TERRAIN_UPLOAD_CHUNKS)
+			remesh[num_remesh++] = i;
+	}
+	bool view_changed =
+		memcmp(viewproj, ctx->culled_viewproj, sizeof(mat4)) != 0;
+	if (!view_changed && num_remesh == 0)
+		return true;
+	memcpy(ctx->culled_viewproj, viewproj, sizeof(mat4));
+
+	SDL_GPUTransferBuffer *trans_buf = acquire_frame_upload(ctx);
+	Uint8 *trans = SDL_MapGPUTransferBuffer(ctx->gpu_dev, trans_buf, false);
+	if (!trans) {
+		log_err("SDL_MapGPUTransferBuffer failed: %s", SDL_GetError());
+		return false;
+	}
+
+	Uint8 *chunk_trans = trans + FRAME_UPLOAD_TERRAIN_OFFSET;
+	for (int i = 0; i < num_remesh; ++i) {
+		int c = remesh[i];
+		struct terrain_mesh mesh = {
+			.vertices = (struct terrain_vertex *)chunk_trans,
+			.indices = (Uint16 *)(chunk_trans +
+					      TERRAIN_CHUNK_MAX_VERTICES *
+						      sizeof(struct terrain_vertex)),
+		};
+		terrain_mesh_chunk(map, c % MAP_CHUNKS_X, c / MAP_CHUNKS_X,
+				   &mesh);
+		struct terrain_chunk *chunk = &ctx->terrain_chunks[c];
+		chunk->num_indices = (Uint32)mesh.num_indices;
+		glm_vec3_copy(mesh.min, chunk->min);
+		glm_vec3_copy(mesh.max, chunk->max);
+		ctx->terrain_dirty[c] = false;
+		chunk_trans += TERRAIN_CHUNK_UPLOAD_SIZE;
+	}
+
+	struct frustum frustum;
+	frustum_from_viewproj(viewproj, &frustum);
+	SDL_GPUIndexedIndirectDrawCommand *cmds =
+		(SDL_GPUIndexedIndirectDrawCommand
+			 *)(trans + FRAME_UPLOAD_TERRAIN_DRAWS_OFFSET);
+	int num_visible = 0;
+	for (int i = 0; i < MAP_LEVEL_CHUNKS; ++i) {
+		const struct terrain_chunk *chunk = &ctx->terrain_chunks[i];
+		bool visible = chunk->num_indices &&
+			       frustum_box_visible(&frustum, chunk->min,
+						   chunk->max);
+		num_visible += visible;
+		cmds[i] = (SDL_GPUIndexedIndirectDrawCommand){
+			.num_indices = chunk->num_indices,
+			.num_instances = visible ? 1 : 0,
+			.first_index = i * TERRAIN_CHUNK_MAX_INDICES,
+			.vertex_offset = i * TERRAIN_CHUNK_MAX_VERTICES,
+			.first_instance = 0
+		};
+	}
+	SDL_UnmapGPUTransferBuffer(ctx->gpu_dev, trans_buf);
+
+	// only the remeshed chunks' slots are uploaded, no cycling
+	SDL_GPUCopyPass *copy_pass = SDL_BeginGPUCopyPass(cmd_buf);
+	Uint32 src_offset = FRAME_UPLOAD_TERRAIN_OFFSET;
+	for (int i = 0; i < num_remesh; ++i) {
+		const struct terrain_chunk *chunk =
+			&ctx->terrain_chunks[remesh[i]];
+		if (!chunk->num_indices) {
+			src_offset += TERRAIN_CHUNK_UPLOAD_SIZE;
+			continue;
+		}
+		// 4 vertices per 6 indices, see emit_quad()
+		const Uint32 num_vertices = chunk->num_indices / 6 * 4;
+		SDL_UploadToGPUBuffer(
+			copy_pass,
+			&(SDL_GPUTransferBufferLocation){
+				.transfer_buffer = trans_buf,
+				.offset = src_offset },
+			&(SDL_GPUBufferRegion){
+				.buffer = ctx->terrain_vertex_buf,
+				.offset = remesh[i] * TERRAIN_CHUNK_MAX_VERTICES *
+					  sizeof(struct terrain_vertex),
+				.size = num_vertices *
+					sizeof(struct terrain_vertex) },
+			false);
+		SDL_UploadToGPUBuffer(
+			copy_pass,
+			&(SDL_GPUTransferBufferLocation){
+				.transfer_buffer = trans_buf,
+				.offset = src_offset +
+					  TERRAIN_CHUNK_MAX_VERTICES *
+						  sizeof(struct terrain_vertex) },
+			&(SDL_GPUBufferRegion){
+				.buffer = ctx->terrain_index_buf,
+				.offset = remesh[i] * TERRAIN_CHUNK_MAX_INDICES *
+					  sizeof(Uint16),
+				.size = chunk->num_indices * sizeof(Uint16) },
+			false);
+		src_offset += TERRAIN_CHUNK_UPLOAD_SIZE;
+	}
 	SDL_UploadToGPUBuffer(
 		copy_pass,
 		&(SDL_GPUTransferBufferLocation){
-			.transfer_buffer = ctx->map_data_draw_trans_buf,
-			.offset = 0 },
+			.transfer_buffer = trans_buf,
+			.offset = FRAME_UPLOAD_TERRAIN_DRAWS_OFFSET },
 		&(SDL_GPUBufferRegion){
-			.buffer = ctx->draw_buf,
+			.buffer = ctx->terrain_draw_buf,
 			.offset = 0,
-			.size = sizeof(SDL_GPUIndexedIndirectDrawCommand) * 1 },
+			.size = sizeof(SDL_GPUIndexedIndirectDrawCommand) *
+				MAP_LEVEL_CHUNKS },
 		true);
 	SDL_EndGPUCopyPass(copy_pass);
+	log_trace("remeshed %d terrain chunks, %d of %d chunks visible",
+		  num_remesh, num_visible, MAP_LEVEL_CHUNKS);
+	return true;
+}
 
-	ctx->last_frame_changed = false;
+// keep the depth texture the size of the swapchain texture
+static bool ensure_depth_target(struct render_context *ctx, Uint32 w, Uint32 h)
+{
+	if (ctx->depth_tex && ctx->depth_w == w && ctx->depth_h == h)
+		return true;
+	if (ctx->depth_tex)
+		SDL_ReleaseGPUTexture(ctx->gpu_dev, ctx->depth_tex);
+	ctx->depth_tex = SDL_CreateGPUTexture(
+		ctx->gpu_dev,
+		&(SDL_GPUTextureCreateInfo){
+			.type = SDL_GPU_TEXTURETYPE_2D,
+			.format = ctx->depth_format,
+			.usage = SDL_GPU_TEXTUREUSAGE_DEPTH_STENCIL_TARGET,
+			.width = w,
+			.height = h,
+			.layer_count_or_depth = 1,
+			.num_levels = 1,
+			.sample_count = SDL_GPU_SAMPLECOUNT_1 });
+	if (!ctx->depth_tex) {
+		log_err("SDL_CreateGPUTexture failed: %s", SDL_GetError());
+		return false;
+	}
+	ctx->depth_w = w;
+	ctx->depth_h = h;
+	log_trace("depth target resized to %ux%u", w, h);
 	return true;
 }
 
+// one command per terrain chunk
+static void draw_terrain(const struct render_context *ctx,
+			 SDL_GPURenderPass *rend_pass,
+			 SDL_GPUGraphicsPipeline *pipeline)
+{
+	SDL_BindGPUGraphicsPipeline(rend_pass, pipeline);
+	SDL_BindGPUVertexBuffers(
+		rend_pass, 0,
+		&(SDL_GPUBufferBinding){ .buffer = ctx->terrain_vertex_buf,
+					 .offset = 0 },
+		1);
+	SDL_BindGPUIndexBuffer(
+		rend_pass,
+		&(SDL_GPUBufferBinding){ .buffer = ctx->terrain_index_buf,
+					 .offset = 0 },
+		SDL_GPU_INDEXELEMENTSIZE_16BIT);
+	SDL_DrawGPUIndexedPrimitivesIndirect(rend_pass, ctx->terrain_draw_buf,
+					     0, MAP_LEVEL_CHUNKS);
+}
+
+SDL_GPUPresentMode render_set_present_mode(SDL_GPUPresentMode mode)
+{
+	// vsync is the one mode every backend supports
+	if (mode != SDL_GPU_PRESENTMODE_VSYNC &&
+	    !SDL_WindowSupportsGPUPresentMode(rend_ctx.gpu_dev,
+					      rend_ctx.rend_info->window,
+					      mode)) {
+		log_warn("present mode %d unsupported, using vsync", mode);
+		mode = SDL_GPU_PRESENTMODE_VSYNC;
+	}
+	if (!SDL_SetGPUSwapchainParameters(rend_ctx.gpu_dev,
+					   rend_ctx.rend_info->window,
+					   SDL_GPU_SWAPCHAINCOMPOSITION_SDR,
+					   mode)) {
+		log_err("SDL_SetGPUSwapchainParameters failed: %s",
+			SDL_GetError());
+		return SDL_GPU_PRESENTMODE_VSYNC;
+	}
+	return mode;
+}
+
 bool render_draw(const struct game_context *game_ctx)
 {
 	// if (in_menu) {
@@ -820,23 +1639,35 @@ bool render_draw(const struct game_context *game_ctx)
 
 	// Do these non-direct-rendering things before acquiring render pass/command buffer
 
-	mat4 camera_transform;
-	camera_to_viewproj(&(game_ctx->player->camera), camera_transform);
+	struct map_uniforms uniforms = {};
+	camera_to_viewproj(&(game_ctx->player->camera), uniforms.viewproj);
+	for (int i = 0; i < MTYPE_COUNT; ++i)
+		glm_vec4_copy(map_type_color[i], uniforms.palette[i]);
 
 	SDL_GPUCommandBuffer *cmd_buf =
 		SDL_AcquireGPUCommandBuffer(rend_ctx.gpu_dev);
 
 	// TODO: update here many copies based on visible map, and push relevant gpu data
-	if (!push_gpu_map_data(&rend_ctx, cmd_buf, game_ctx->visible_map)) {
-		log_err("push_gpu_map_data failed");
+	if (rend_ctx.map_path == MAP_PATH_TERRAIN) {
+		if (!push_terrain(&rend_ctx, cmd_buf, &game_ctx->map,
+				  uniforms.viewproj))
+			log_err("push_terrain failed");
+	} else {
+		if (!push_gpu_map_data(&rend_ctx, cmd_buf, &game_ctx->map,
+				       uniforms.viewproj))
+			log_err("push_gpu_map_data failed");
+		cull_map_tiles(&rend_ctx, cmd_buf, uniforms.viewproj);
 	}
 
 	SDL_GPUTexture *swapchain_texture = NULL;
+	Uint32 swapchain_w, swapchain_h;
 	SDL_WaitAndAcquireGPUSwapchainTexture(cmd_buf,
 					      rend_ctx.rend_info->window,
-					      &swapchain_texture, NULL, NULL);
+					      &swapchain_texture, &swapchain_w,
+					      &swapchain_h);
 
-	if (swapchain_texture) {
+	if (swapchain_texture &&
+	    ensure_depth_target(&rend_ctx, swapchain_w, swapchain_h)) {
 		SDL_GPUColorTargetInfo color_target_info = { 0 };
 		color_target_info.texture = swapchain_texture;
 		color_target_info.clear_color =
@@ -844,53 +1675,107 @@ bool render_draw(const struct game_context *game_ctx)
 		color_target_info.load_op = SDL_GPU_LOADOP_CLEAR;
 		color_target_info.store_op = SDL_GPU_STOREOP_STORE;
 
+		// depth is only needed within the frame
+		SDL_GPUDepthStencilTargetInfo depth_target_info = {
+			.texture = rend_ctx.depth_tex,
+			.clear_depth = 1.0f,
+			.load_op = SDL_GPU_LOADOP_CLEAR,
+			.store_op = SDL_GPU_STOREOP_DONT_CARE,
+			.stencil_load_op = SDL_GPU_LOADOP_DONT_CARE,
+			.stencil_store_op = SDL_GPU_STOREOP_DONT_CARE,
+			.cycle = true
+		};
+
 		SDL_GPURenderPass *rend_pass = SDL_BeginGPURenderPass(
-			cmd_buf, &color_target_info, 1, NULL);
+			cmd_buf, &color_target_info, 1, &depth_target_info);
+		SDL_PushGPUVertexUniformData(cmd_buf, 0, &uniforms,
+					     sizeof(uniforms));
+
+		if (rend_ctx.terrain_depth_pipeline)
+			draw_terrain(&rend_ctx, rend_pass,
+				     rend_ctx.terrain_depth_pipeline);
+		if (rend_ctx.terrain_pipeline)
+			draw_terrain(&rend_ctx, rend_pass,
+				     rend_ctx.terrain_pipeline);
 
 		// bind resources:
 		SDL_BindGPUGraphicsPipeline(rend_pass, rend_ctx.pipeline);
-		// vertices:
+		// vertices and instances:
 		SDL_BindGPUVertexBuffers(
 			rend_pass, 0,
-			&(SDL_GPUBufferBinding){ .buffer = rend_ctx.vertex_buf,
-						 .offset = 0 },
-			1);
+			(SDL_GPUBufferBinding[]){
+				{ .buffer = rend_ctx.vertex_buf, .offset = 0 },
+				{ .buffer = rend_ctx.instance_buf, .offset = 0 } },
+			2);
 		// vertex index:
 		SDL_BindGPUIndexBuffer(
 			rend_pass,
 			&(SDL_GPUBufferBinding){ .buffer = rend_ctx.index_buf,
 						 .offset = 0 },
 			SDL_GPU_INDEXELEMENTSIZE_16BIT);
-		// map pos data:
-		// we do this one instead of pushing uniform data
-		SDL_BindGPUVertexStorageBuffers(rend_pass, 0,
-						&(rend_ctx.map_data_buf), 1);
-
-		SDL_PushGPUVertexUniformData(cmd_buf, 0, camera_transform,
-					     sizeof(mat4));
 
+		// one command per mesh type
 		SDL_DrawGPUIndexedPrimitivesIndirect(rend_pass,
-						     rend_ctx.draw_buf, 0, 1);
+						     rend_ctx.draw_buf, 0,
+						     MESH_COUNT);
 
 		SDL_EndGPURenderPass(rend_pass);
 	}
 
-	SDL_SubmitGPUCommandBuffer(cmd_buf);
+	submit_frame(&rend_ctx, cmd_buf);
 	return true;
 }
 
-void render_quit()
+static void release_gpu(void)
 {
-	SDL_ReleaseWindowFromGPUDevice(rend_ctx.gpu_dev,
-				       rend_ctx.rend_info->window);
-
-	SDL_ReleaseGPUTransferBuffer(rend_ctx.gpu_dev,
-				     rend_ctx.map_data_draw_trans_buf);
-	SDL_ReleaseGPUBuffer(rend_ctx.gpu_dev, rend_ctx.map_data_buf);
+	SDL_ReleaseWindowFromGPUDevice(rend_ctx.gpu_dev, rend_info.window);
+
+	SDL_WaitForGPUIdle(rend_ctx.gpu_dev);
+	log_info("cpu waited on gpu upload buffers %llu times",
+		 (unsigned long long)rend_ctx.rend_info->upload_waits);
+	for (int i = 0; i < RENDER_FRAMES_IN_FLIGHT; ++i) {
+		struct frame_upload *frame = &rend_ctx.frames[i];
+		if (frame->fence)
+			SDL_ReleaseGPUFence(rend_ctx.gpu_dev, frame->fence);
+		SDL_ReleaseGPUTransferBuffer(rend_ctx.gpu_dev,
+					     frame->trans_buf);
+	}
+	SDL_ReleaseGPUBuffer(rend_ctx.gpu_dev, rend_ctx.instance_buf);
+	if (rend_ctx.depth_tex)
+		SDL_ReleaseGPUTexture(rend_ctx.gpu_dev, rend_ctx.depth_tex);
+	if (rend_ctx.terrain_depth_pipeline)
+		SDL_ReleaseGPUGraphicsPipeline(rend_ctx.gpu_dev,
+					       rend_ctx.terrain_depth_pipeline);
+	if (rend_ctx.terrain_pipeline) {
+		SDL_ReleaseGPUGraphicsPipeline(rend_ctx.gpu_dev,
+					       rend_ctx.terrain_pipeline);
+		SDL_ReleaseGPUBuffer(rend_ctx.gpu_dev,
+				     rend_ctx.terrain_vertex_buf);
+		SDL_ReleaseGPUBuffer(rend_ctx.gpu_dev,
+				     rend_ctx.terrain_index_buf);
+		SDL_ReleaseGPUBuffer(rend_ctx.gpu_dev,
+				     rend_ctx.terrain_draw_buf);
+	}
+	if (rend_ctx.cull_pipeline) {
+		SDL_ReleaseGPUComputePipeline(rend_ctx.gpu_dev,
+					      rend_ctx.cull_pipeline);
+		SDL_ReleaseGPUBuffer(rend_ctx.gpu_dev, rend_ctx.tile_buf);
+	}
 	SDL_ReleaseGPUBuffer(rend_ctx.gpu_dev, rend_ctx.vertex_buf);
 	SDL_ReleaseGPUBuffer(rend_ctx.gpu_dev, rend_ctx.index_buf);
 	SDL_ReleaseGPUBuffer(rend_ctx.gpu_dev, rend_ctx.draw_buf);
 
 	SDL_DestroyGPUDevice(rend_ctx.gpu_dev);
-	SDL_DestroyWindow(rend_ctx.rend_info->window);
+	rend_ctx.gpu_dev = NULL;
+}
+
+void render_quit()
+{
+	// render_init() may have failed part way
+	if (rend_ctx.gpu_dev)
+		release_gpu();
+	if (rend_info.window)
+		SDL_DestroyWindow(rend_info.window);
+	rend_info.window = NULL;
+	asset_quit();
 }
@@ -17,12 +17,17 @@ struct render_info {
 	SDL_Window *window;
 	SDL_WindowID window_id;
 	int win_w, win_h;
+	// frames where the cpu had to wait for the gpu to free an upload buffer
+	uint64_t upload_waits;
 };
 
 extern struct render_info rend_info;
 
 bool render_init();
 bool render_draw(const struct game_context *game_ctx);
+// falls back to vsync if the window can't present in mode, returns the mode
+// in use. render_init() starts out with vsync
+SDL_GPUPresentMode render_set_present_mode(SDL_GPUPresentMode mode);
 void render_quit();
 
 #endif
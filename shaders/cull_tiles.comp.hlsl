@@ -0,0 +1,62 @@
+// frustum culls the map tile instances, appending the visible ones to the
+// tile range of the instance buffer and counting them into the tile draw
+// command. cull_tiles() in cull.c is the cpu reference. runs for
+// AN_MAP_PATH=GPU_CULL, and when the terrain path can't be set up
+
+// from map.h
+enum map_type {
+	MTYPE_NONE,
+	MTYPE_WALL,
+	MTYPE_FLOOR,
+	MTYPE_UNEXPLORED,
+	MTYPE_UNKNOWN,
+	MTYPE_COUNT
+};
+
+// see TILE_HALF_EXTENT in cull.h
+#define TILE_HALF_EXTENT 1.0f
+
+// see struct cull_uniforms in render.c
+cbuffer UBO : register(b0, space2)
+{
+	float4 planes[6] : packoffset(c0);
+	uint tile_count : packoffset(c6.x);
+	uint first_instance : packoffset(c6.y);
+	uint draw_count_offset : packoffset(c6.z);
+};
+
+// every tile instance, 8 bytes each, see struct gpu_map_instance in map_instance.h
+// word 0: int16 tile x | int16 tile y << 16
+// word 1: uint8 type | uint8 flags << 8
+ByteAddressBuffer tiles : register(t0, space0);
+RWByteAddressBuffer instances : register(u0, space1);
+RWByteAddressBuffer draw_cmds : register(u1, space1);
+
+[numthreads(64, 1, 1)]
+void main(uint3 id : SV_DispatchThreadID)
+{
+	if (id.x >= tile_count)
+		return;
+
+	uint2 elem = tiles.Load2(8 * id.x);
+	// sign extend the 16 bit coords
+	int map_x = (int)(elem.x << 16) >> 16;
+	int map_y = (int)elem.x >> 16;
+	int type = elem.y & 0xff;
+
+	// see map_tile_center() in cull.h
+	float3 center = { map_y * -2.0f + 0.5f, 0.0f, map_x * 2.0f + 0.5f };
+	if (type == MTYPE_FLOOR)
+		center.y = -2.0f;
+
+	// tile box against each plane, see cull_scalar() in cull.c
+	for (int i = 0; i < 6; ++i) {
+		float limit = -TILE_HALF_EXTENT * dot(abs(planes[i].xyz), 1.0f);
+		if (dot(planes[i].xyz, center) + planes[i].w < limit)
+			return;
+	}
+
+	uint slot;
+	draw_cmds.InterlockedAdd(draw_count_offset, 1, slot);
+	instances.Store2(8 * (first_instance + slot), elem);
+}
@@ -1,25 +1,27 @@
 #define IDENTITY_MATRIX float4x4(1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1)
 
-// from game.h
+// from map.h
 enum map_type {
 	MTYPE_NONE,
 	MTYPE_WALL,
 	MTYPE_FLOOR,
+	MTYPE_UNEXPLORED,
 	MTYPE_UNKNOWN,
 	MTYPE_COUNT
 };
 
+// see struct map_uniforms in render.c
 cbuffer UBO : register(b0, space1)
 {
 	float4x4 viewproj : packoffset(c0);
+	float4 palette[8] : packoffset(c4);
 };
 
-// elem size: 32 bytes, see below
-ByteAddressBuffer data_buffer : register(t0, space2);
-
+// per instance attributes, see struct gpu_map_instance in map_instance.h
 struct main_in {
 	float3 position : TEXCOORD0;
-	uint id : SV_InstanceID;
+	int2 tile : TEXCOORD1; // SHORT2 map cell
+	uint4 type_flags : TEXCOORD2; // UBYTE4 type, flags, padding
 };
 
 struct main_out {
@@ -39,12 +41,15 @@ float4x4 m_translate(float4x4 m, float3 v)
 main_out main(main_in input)
 {
 	// shift and use the appropriate color/texture
-	// see “GLSL std140 layout”, buffer needs 16 byte alignment
-	float tile_x = asfloat(data_buffer.Load(32 * input.id));
-	float tile_y = asfloat(data_buffer.Load(4 + 32 * input.id));
-	float tile_z = asfloat(data_buffer.Load(8 + 32 * input.id));
-	int type = asint(data_buffer.Load(12 + 32 * input.id));
-	float4 color = asfloat(data_buffer.Load4(16 + 32 * input.id));
+	int map_x = input.tile.x;
+	int map_y = input.tile.y;
+	int type = input.type_flags.x;
+	float4 color = palette[type];
+
+	// cube extends +-1 xyz i.e. width = 2.0
+	// NOTE need to flip axis
+	float tile_x = map_y * -2.0f + 0.5f;
+	float tile_y = map_x * 2.0f + 0.5f;
 
 	float3 shift = { tile_x, 0.0f, tile_y };
 	if (type == MTYPE_FLOOR)
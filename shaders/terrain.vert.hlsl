@@ -0,0 +1,25 @@
+// see struct map_uniforms in render.c
+cbuffer UBO : register(b0, space1)
+{
+	float4x4 viewproj : packoffset(c0);
+	float4 palette[8] : packoffset(c4);
+};
+
+// see struct terrain_vertex in mesher.h, positions are already in world space
+struct main_in {
+	float3 position : TEXCOORD0;
+	uint type : TEXCOORD1; // enum map_type
+};
+
+struct main_out {
+	float4 color : TEXCOORD0;
+	float4 position : SV_Position;
+};
+
+main_out main(main_in input)
+{
+	main_out output;
+	output.position = mul(viewproj, float4(input.position, 1.0f));
+	output.color = palette[input.type];
+	return output;
+}
@@ -0,0 +1,76 @@
+#include "spsc.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+bool spsc_init(struct spsc_ring *ring, size_t elem_size, size_t capacity)
+{
+	assert(capacity && (capacity & (capacity - 1)) == 0);
+	ring->slots = calloc(capacity, elem_size);
+	if (!ring->slots)
+		return false;
+	ring->elem_size = elem_size;
+	ring->mask = capacity - 1;
+	atomic_init(&ring->head, 0);
+	atomic_init(&ring->tail, 0);
+	return true;
+}
+
+void spsc_free(struct spsc_ring *ring)
+{
+	free(ring->slots);
+	ring->slots = NULL;
+}
+
+void *spsc_reserve(struct spsc_ring *ring)
+{
+	size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+	// acquire pairs with the consumer's release so it is done with the slot
+	size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+	if (tail - head > ring->mask)
+		return NULL;
+	return ring->slots + (tail & ring->mask) * ring->elem_size;
+}
+
+void spsc_commit(struct spsc_ring *ring)
+{
+	size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+	// release publishes the slot contents before the new tail
+	atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+}
+
+bool spsc_push(struct spsc_ring *ring, const void *elem)
+{
+	void *slot = spsc_reserve(ring);
+	if (!slot)
+		return false;
+	memcpy(slot, elem, ring->elem_size);
+	spsc_commit(ring);
+	return true;
+}
+
+const void *spsc_peek(struct spsc_ring *ring)
+{
+	size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+	size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+	if (head == tail)
+		return NULL;
+	return ring->slots + (head & ring->mask) * ring->elem_size;
+}
+
+void spsc_release(struct spsc_ring *ring)
+{
+	size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+	atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+bool spsc_pop(struct spsc_ring *ring, void *elem)
+{
+	const void *slot = spsc_peek(ring);
+	if (!slot)
+		return false;
+	memcpy(elem, slot, ring->elem_size);
+	spsc_release(ring);
+	return true;
+}
@@ -0,0 +1,40 @@
+#ifndef SPSC_H
+#define SPSC_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// lock-free single-producer/single-consumer ring of fixed-size slots.
+// exactly one thread may call the producer functions (reserve/commit/push) and
+// exactly one other thread the consumer functions (peek/release/pop).
+// slots are accessed in place, so large elements never need an extra copy
+struct spsc_ring {
+	// next slot to read, only written by the consumer
+	_Alignas(64) atomic_size_t head;
+	// next slot to write, only written by the producer
+	_Alignas(64) atomic_size_t tail;
+	_Alignas(64) char *slots;
+	size_t elem_size;
+	size_t mask; // capacity - 1, capacity is a power of two
+};
+
+// capacity must be a power of two
+bool spsc_init(struct spsc_ring *ring, size_t elem_size, size_t capacity);
+void spsc_free(struct spsc_ring *ring);
+
+// producer: get the next free slot to fill in, NULL if the ring is full.
+// the slot becomes visible to the consumer on spsc_commit()
+void *spsc_reserve(struct spsc_ring *ring);
+void spsc_commit(struct spsc_ring *ring);
+// reserve + copy + commit
+bool spsc_push(struct spsc_ring *ring, const void *elem);
+
+// consumer: get the oldest filled slot, NULL if the ring is empty.
+// the slot is handed back to the producer on spsc_release()
+const void *spsc_peek(struct spsc_ring *ring);
+void spsc_release(struct spsc_ring *ring);
+// peek + copy + release
+bool spsc_pop(struct spsc_ring *ring, void *elem);
+
+#endif
@@ -0,0 +1,69 @@
+#include "startup.h"
+#include "log.h"
+
+#include <SDL3/SDL.h>
+
+struct startup_phase {
+	const char *name;
+	Uint64 begin_ns, end_ns; // end_ns 0 while running
+	SDL_ThreadID thread;
+};
+
+static Uint64 epoch_ns;
+static SDL_ThreadID main_thread;
+static struct startup_phase phases[STARTUP_MAX_PHASES];
+static SDL_AtomicInt num_phases;
+static SDL_AtomicInt num_running;
+
+void startup_init(void)
+{
+	epoch_ns = SDL_GetTicksNS();
+	main_thread = SDL_GetCurrentThreadID();
+	SDL_SetAtomicInt(&num_phases, 0);
+	SDL_SetAtomicInt(&num_running, 0);
+}
+
+int startup_begin(const char *name)
+{
+	int phase = SDL_AddAtomicInt(&num_phases, 1);
+	if (phase >= STARTUP_MAX_PHASES) {
+		log_warn("too many startup phases, not timing %s", name);
+		return -1;
+	}
+	SDL_AddAtomicInt(&num_running, 1);
+	phases[phase] = (struct startup_phase){ .name = name,
+						.begin_ns = SDL_GetTicksNS(),
+						.thread = SDL_GetCurrentThreadID() };
+	return phase;
+}
+
+void startup_end(int phase)
+{
+	if (phase < 0)
+		return;
+	phases[phase].end_ns = SDL_GetTicksNS();
+	SDL_AddAtomicInt(&num_running, -1);
+}
+
+bool startup_pending(void)
+{
+	return SDL_GetAtomicInt(&num_running) > 0;
+}
+
+void startup_dump(void)
+{
+	int count = SDL_min(SDL_GetAtomicInt(&num_phases), STARTUP_MAX_PHASES);
+
+	log_info("startup timeline, ms since start:");
+	for (int i = 0; i < count; ++i) {
+		const struct startup_phase *p = &phases[i];
+		double begin = (p->begin_ns - epoch_ns) / 1e6;
+		if (!p->end_ns) {
+			log_info("  %-24s %8.2f -> running", p->name, begin);
+			continue;
+		}
+		double end = (p->end_ns - epoch_ns) / 1e6;
+		log_info("  %-24s %8.2f -> %8.2f %8.2f%s", p->name, begin, end,
+			 end - begin, p->thread == main_thread ? "" : " (thread)");
+	}
+}
@@ -0,0 +1,24 @@
+#ifndef STARTUP_H
+#define STARTUP_H
+
+#include <stdbool.h>
+
+// wall clock timeline of client startup. phases may overlap and run on any
+// thread, each is begun and ended by one thread. startup_dump() logs them all
+// relative to startup_init(), so time to first frame reads straight off it
+
+#define STARTUP_MAX_PHASES 32
+
+void startup_init(void);
+
+// returns the phase to end, -1 if there are too many phases. name must
+// outlive the timeline
+int startup_begin(const char *name);
+void startup_end(int phase);
+
+// true while a begun phase hasn't ended
+bool startup_pending(void);
+
+void startup_dump(void);
+
+#endif
@@ -6,44 +6,115 @@
 #include <assert.h>
 #include <stdio.h>
 
-bool do_turn(const struct turn *turn, struct game_context *ctx)
-{
-	log_trace("doing turn");
+struct pending_turn {
+	struct turn turn;
+	uint32_t seq;
+	turn_done_fn on_done;
+};
 
-	assert(turn);
-	bool success = true;
+// fifo of submitted turns awaiting their response. the network thread sends
+// them in order and the server answers in order, so a response completes the
+// turns from the head up to the seq it answers
+static struct pending_turn turn_queue[TURN_QUEUE_LEN];
+static int queue_head;
+static int queue_len;
+// the network side expects consecutive seqs, so one is only used up once
+// its turn is queued
+static uint32_t next_seq = 1;
 
+bool turn_submit(const struct turn *turn, turn_done_fn on_done)
+{
+	assert(turn);
 	if (turn->type == TURN_ERR) {
 		log_err("failed to process event");
-		success = false;
+		return false;
+	}
+	if (queue_len == TURN_QUEUE_LEN || !net_data_submit(turn, next_seq)) {
+		log_warn("turn queue full, dropping turn");
+		return false;
 	}
+	int tail = (queue_head + queue_len) % TURN_QUEUE_LEN;
+	turn_queue[tail] = (struct pending_turn){ .turn = *turn,
+						  .seq = next_seq,
+						  .on_done = on_done };
+	++next_seq;
+	++queue_len;
+	return true;
+}
 
-	const char *turn_message = turn_to_message(turn);
-	if (!turn_message)
-		success = false;
+int turn_pending(void)
+{
+	return queue_len;
+}
 
-	printf("sending message: \n%s\n", turn_message);
+static void complete_head(bool success, struct game_context *ctx)
+{
+	struct pending_turn *head = &turn_queue[queue_head];
 
-	if (!send_turn_message(turn_message))
-		success = false;
+	if (success)
+		++(ctx->time.game_turn);
+	if (head->on_done)
+		head->on_done(&head->turn, success, ctx);
 
-	const char *response = get_turn_response();
-	if (!response)
-		success = false;
+	queue_head = (queue_head + 1) % TURN_QUEUE_LEN;
+	--queue_len;
+}
 
-	success = process_turn_response(response, ctx);
+// complete every queued turn up to and including seq, returns how many
+static int complete_through(uint32_t seq, bool success,
+			    struct game_context *ctx)
+{
+	int completed = 0;
+	while (queue_len > 0 &&
+	       (int32_t)(turn_queue[queue_head].seq - seq) <= 0) {
+		complete_head(success, ctx);
+		++completed;
+	}
+	return completed;
+}
 
-	if (success)
-		++(ctx->time.game_turn);
-	return success;
+void turn_poll(struct game_context *ctx)
+{
+	// only drains the incoming ring, no syscalls
+	const struct net_update *update;
+	while ((update = net_data_peek_update())) {
+		apply_net_update(update, ctx);
+		if (update->last && update->answers_turn &&
+		    !complete_through(update->seq, update->success, ctx))
+			log_warn("response with no pending turn");
+		net_data_release_update();
+	}
 }
 
-void free_turn(struct turn *turn)
+void turn_flush(struct game_context *ctx)
 {
-	if (turn->type == TURN_TESTMALLOC) {
-		// free(); // for heap turns, their proper destructor
-		// more else if's for other specific turns...
-	} else {
-		return;
+	turn_poll(ctx);
+	while (queue_len > 0) {
+		net_data_wait_update(100);
+		turn_poll(ctx);
 	}
 }
+
+struct do_turn_result {
+	bool done;
+	bool success;
+};
+
+static struct do_turn_result do_turn_result;
+
+static void do_turn_done(const struct turn *turn, bool success,
+			 struct game_context *ctx)
+{
+	do_turn_result = (struct do_turn_result){ .done = true,
+						  .success = success };
+}
+
+bool do_turn(const struct turn *turn, struct game_context *ctx)
+{
+	do_turn_result = (struct do_turn_result){ 0 };
+	if (!turn_submit(turn, do_turn_done))
+		return false;
+	turn_flush(ctx);
+	assert(do_turn_result.done);
+	return do_turn_result.success;
+}
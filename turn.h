@@ -5,7 +5,7 @@ struct game_context;
 
 #include <stdbool.h>
 
-enum turn_type { TURN_MOVE, TURN_TESTMALLOC, TURN_ERR };
+enum turn_type { TURN_MOVE, TURN_ERR };
 
 enum move_direction {
 	MOVE_NONE, // didn't clear a cell
@@ -30,8 +30,35 @@ struct turn {
 	union turn_data value;
 };
 
-bool do_turn(const struct turn *turn, struct game_context *ctx);
+// called once the server response for a submitted turn has been applied to ctx
+// (or the turn failed to send/receive), from within turn_poll()
+typedef void (*turn_done_fn)(const struct turn *turn, bool success,
+			     struct game_context *ctx);
+
+// max turns waiting to be sent or answered at once
+#define TURN_QUEUE_LEN 32
+
+// turns are plain values. producers fill in one on their own stack and
+// turn_submit() copies it into the fixed queue below, which is the only
+// storage a turn has until it is answered. nothing on the input path
+// allocates, and memory stays constant however long the session runs
+
+// queue a turn for sending and return immediately. the turn is copied, so the
+// caller keeps ownership of *turn. on_done may be NULL.
+// returns false if the queue is full
+bool turn_submit(const struct turn *turn, turn_done_fn on_done);
 
-void free_turn(struct turn *turn);
+// advance the turn pipeline without blocking: send the next queued turn and
+// apply any response that has arrived. call once per frame
+void turn_poll(struct game_context *ctx);
+
+// block until every queued turn has been answered
+void turn_flush(struct game_context *ctx);
+
+// number of turns queued or awaiting a response
+int turn_pending(void);
+
+// blocking submit+flush, for use outside the frame loop e.g. at startup
+bool do_turn(const struct turn *turn, struct game_context *ctx);
 
 #endif